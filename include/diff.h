@@ -3,48 +3,170 @@
 
 #include <list>
 #include <map>
+#include <memory>
 
 #include "internal/calculation.h"
+#include "internal/chunking.h"
+#include "internal/compose.h"
+#include "internal/delta.h"
+#include "internal/efficiency_cleanup.h"
+#include "internal/executor.h"
+#include "internal/file_diff.h"
+#include "internal/flat_result.h"
+#include "internal/mapped_script.h"
+#include "internal/merge.h"
+#include "internal/patch.h"
+#include "internal/patch_apply.h"
 #include "internal/range_traits.h"
 #include "internal/semantic_cleanup.h"
+#include "internal/serialization.h"
+#include "internal/stats.h"
+#include "internal/unified.h"
+#include "internal/visitor_sink.h"
 
 namespace izi {
 namespace diff {
 
-template<typename Range, typename Traits = detail::range_traits<Range> >
+/*! Edit script of two ranges.
+ *
+ * All storage of the calculation (hunks, line transformation tables and
+ * bisect buffers) is obtained from the allocator, rebound as needed.
+ */
+template<typename Range, typename Traits = detail::range_traits<Range>,
+		typename Allocator = std::allocator<std::pair<operation, Range> > >
 class result
 {
 public:
 	typedef std::pair<operation, Range> value_type;
 	typedef typename Range::value_type element_type;
-	typedef std::list<value_type> container_type;
-	typedef typename container_type::iterator iterator;
+	typedef Allocator allocator_type;
+	typedef std::list<value_type, allocator_type> container_type;
 	typedef typename container_type::const_iterator const_iterator;
+	typedef const_iterator iterator;
+	typedef diff::patch<const_iterator> patch_type;
 
-	void calculate(const Range& iRange1, const Range& iRange2)
+	explicit result(const allocator_type& iAllocator = allocator_type()): _result(iAllocator) {}
+
+	void calculate(const Range& iRange1, const Range& iRange2, const options& iOptions = options())
+	{
+		detail::calculate<Traits>(iRange1.begin(), iRange1.end(), iRange2.begin(), iRange2.end(), _result, iOptions, _stats);
+	}
+
+	/*! Diff of large byte ranges, e.g. std::string or std::vector<unsigned char>,
+	 *  split into content defined chunks.
+	 *
+	 * Runs of chunks found in both ranges are equalities, the chunks between
+	 * them are diffed as separate tasks of the executor, e.g. concurrently
+	 * with thread_executor, and spliced in order. Ranges shorter than a few
+	 * chunks or of other elements are diffed as by calculate().
+	 *
+	 * The tasks allocate their hunks from copies of the result's allocator,
+	 * so with a concurrent executor it must be thread safe, e.g. not a
+	 * std::pmr::monotonic_buffer_resource shared by all tasks.
+	 */
+	template<typename Executor>
+	void calculate(const Range& iRange1, const Range& iRange2, const Executor& iExecutor,
+			const options& iOptions = options())
 	{
-		detail::calculate<Traits>(iRange1.begin(), iRange1.end(), iRange2.begin(), iRange2.end(), _result);
+		detail::calculate_chunked<Traits>(iRange1.begin(), iRange1.end(), iRange2.begin(), iRange2.end(), _result,
+				iExecutor, iOptions, _stats);
 	}
 
 	void cleanup()
 	{
-		detail::semantic_cleanup<Traits>(_result);
+		detail::semantic_cleanup<Traits>(_result, _stats);
 	}
 
-public:
-	iterator begin()
+	/*! Semantic cleanup of the segments between equalities at least
+	 *  iSplitSize long, run through the executor.
+	 *
+	 * Long equalities are kept as they are, e.g. thread_executor cleans
+	 * the segments of large results in parallel. The segments allocate from
+	 * copies of the result's allocator, so with a concurrent executor it
+	 * must be thread safe.
+	 */
+	template<typename Executor>
+	void cleanup(const Executor& iExecutor, size_t iSplitSize = detail::kDefaultSplitSize)
 	{
-		return _result.begin();
+		detail::semantic_cleanup<Traits>(_result, iExecutor, iSplitSize, _stats);
 	}
 
-	const_iterator begin() const
+	/*! Merges short equalities into the surrounding edits when an edit costs
+	 *  more than keeping them, for diffs consumed by machines.
+	 *
+	 * @param iEditCost cost of an edit in elements
+	 */
+	void cleanup_efficiency(size_t iEditCost = detail::kDefaultEditCost)
 	{
-		return _result.begin();
+		detail::cleanup_efficiency(_result, iEditCost, _stats);
 	}
 
-	iterator end()
+	/*! Replaces hunks with copies of (operation, range) pairs,
+	 *  e.g. lazy views of flat_result.
+	 */
+	template<typename InputIterator>
+	void assign(InputIterator iBegin, InputIterator iEnd)
 	{
-		return _result.end();
+		_result.clear();
+		_stats = diff::stats();
+		for(; iBegin != iEnd; ++iBegin)
+		{
+			const typename std::iterator_traits<InputIterator>::value_type aValue(*iBegin);
+			_result.push_back(std::make_pair(aValue.first, Range(aValue.second.begin(), aValue.second.end())));
+			_stats.add(aValue.first, _result.back().second.size());
+		}
+	}
+
+	/*! Diff of A and C composed of the diffs of A and B and of B and C,
+	 *  in one pass over both without diffing again.
+	 *
+	 * The B of both diffs must be the same, see detail::compose().
+	 *
+	 * @return false if the lengths of their Bs differ, the result is left
+	 *         unchanged then
+	 */
+	bool compose(const result& iFirst, const result& iSecond)
+	{
+		container_type aResult(_result.get_allocator());
+		if(!detail::compose(iFirst.begin(), iFirst.end(), iSecond.begin(), iSecond.end(), aResult))
+		{
+			return false;
+		}
+		diff::stats aStats;
+		detail::cleanup_first_pass(aResult, aStats);
+		_result.swap(aResult);
+		_stats = aStats;
+		return true;
+	}
+
+	//! Turns the diff of A and B into the diff of B and A.
+	void invert()
+	{
+		detail::invert(_result);
+		_stats.invert();
+	}
+
+	/*! Statistics of the current hunks, kept up to date by the operations
+	 *  as they append, merge and split hunks.
+	 */
+	const diff::stats& stats() const
+	{
+		return _stats;
+	}
+
+	/*! Appends patches of the hunks with iMargin elements of context,
+	 *  e.g. to a std::vector<patch_type>.
+	 */
+	template<typename Patches>
+	void make_patches(Patches& oPatches, size_t iMargin = kDefaultPatchMargin) const
+	{
+		diff::make_patches(_result.begin(), _result.end(), oPatches, iMargin);
+	}
+
+public:
+	const_iterator begin() const
+	{
+		return _result.begin();
 	}
 
 	const_iterator end() const
@@ -62,10 +184,62 @@ public:
 		return _result.empty();
 	}
 
+	allocator_type get_allocator() const
+	{
+		return _result.get_allocator();
+	}
+
+	//! Moves the hunks out of the result leaving it empty.
+	container_type release()
+	{
+		container_type aResult(_result.get_allocator());
+		aResult.swap(_result);
+		_stats = diff::stats();
+		return aResult;
+	}
+
+	void swap(result& ioResult)
+	{
+		_result.swap(ioResult._result);
+		std::swap(_stats, ioResult._stats);
+	}
+
 private:
 	container_type _result;
+	diff::stats _stats;
 };
 
+/*! Streams the diff of two ranges to the visitor without building a result.
+ *
+ * Visitor receives hunks in order through on_equal(begin, end),
+ * on_remove(begin, end) and on_insert(begin, end). Equal and removed
+ * elements are views into the first range, inserted ones into the second.
+ * Hunks are merged and normalised as by the basic cleanup, edits are not
+ * shifted across equalities.
+ */
+template<typename Traits, typename Range, typename Visitor, typename Allocator>
+void compute(const Range& iRange1, const Range& iRange2, Visitor& ioVisitor, const Allocator& iAllocator,
+		const options& iOptions = options())
+{
+	typedef typename Range::const_iterator iterator;
+
+	detail::visitor_sink<Visitor, iterator, Allocator> aSink(ioVisitor, iRange1.begin(), iRange2.begin(), iAllocator);
+	detail::calculate_hunks<Traits>(iRange1.begin(), iRange1.end(), iRange2.begin(), iRange2.end(), aSink, iOptions);
+	aSink.flush();
+}
+
+template<typename Traits, typename Range, typename Visitor>
+void compute(const Range& iRange1, const Range& iRange2, Visitor& ioVisitor)
+{
+	compute<Traits>(iRange1, iRange2, ioVisitor, std::allocator<void>());
+}
+
+template<typename Range, typename Visitor>
+void compute(const Range& iRange1, const Range& iRange2, Visitor& ioVisitor)
+{
+	compute<detail::range_traits<Range> >(iRange1, iRange2, ioVisitor);
+}
+
 }  // namespace diff
 }  // namespace izi
 
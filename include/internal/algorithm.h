@@ -2,6 +2,7 @@
 #define DIFF_ALGORITHM_H_
 
 #include <algorithm>
+#include <cstddef>
 #include <iterator>
 
 namespace izi {
@@ -61,30 +62,122 @@ inline Iterator common_suffix(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2
 	}
 }
 
+/*! Length of the longest suffix of the first range which is also a prefix
+ *  of the second one.
+ *
+ * Grows the candidate overlap by searching its tail in the second range,
+ * see http://neil.fraser.name/news/2010/11/04/
+ */
 template<typename Iterator>
-inline bool equal(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2)
+inline size_t common_overlap(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2)
 {
-	return (std::distance(iBegin1, iEnd1) == std::distance(iBegin2, iEnd2)) &&
-			std::equal(iBegin1, iEnd1, iBegin2);
+	const size_t aSize1 = std::distance(iBegin1, iEnd1);
+	const size_t aSize = std::min(aSize1, static_cast<size_t>(std::distance(iBegin2, iEnd2)));
+	iBegin1 = next(iBegin1, aSize1 - aSize);
+	iEnd2 = next(iBegin2, aSize);
+	if(std::equal(iBegin1, iEnd1, iBegin2))
+	{
+		return aSize;
+	}
+
+	size_t aBest(0);
+	for(size_t aLength = 1; aLength <= aSize;)
+	{
+		const Iterator aFoundIt = std::search(iBegin2, iEnd2, prior(iEnd1, aLength), iEnd1);
+		if(aFoundIt == iEnd2)
+		{
+			break;
+		}
+		const size_t aFound = std::distance(iBegin2, aFoundIt);
+		aLength += aFound;
+		if((aFound == 0) || std::equal(prior(iEnd1, aLength), iEnd1, iBegin2))
+		{
+			aBest = aLength;
+			++aLength;
+		}
+	}
+	return aBest;
 }
 
-template<typename Range>
-void partition(Range& ioRng1, Range& ioRng2, Range& oCommonPfx, Range& oCommonSfx)
+//! Elements without a byte key are searched by std::search.
+struct unkeyed_element {};
+//! Integral elements are keyed by their lowest byte in skip tables.
+struct keyed_element {};
+
+template<typename T> struct element_key { typedef unkeyed_element type; };
+template<> struct element_key<char> { typedef keyed_element type; };
+template<> struct element_key<signed char> { typedef keyed_element type; };
+template<> struct element_key<unsigned char> { typedef keyed_element type; };
+template<> struct element_key<wchar_t> { typedef keyed_element type; };
+template<> struct element_key<short> { typedef keyed_element type; };
+template<> struct element_key<unsigned short> { typedef keyed_element type; };
+template<> struct element_key<int> { typedef keyed_element type; };
+template<> struct element_key<unsigned int> { typedef keyed_element type; };
+template<> struct element_key<long> { typedef keyed_element type; };
+template<> struct element_key<unsigned long> { typedef keyed_element type; };
+
+//! Ranges shorter than this are searched by std::search, the skip table costs more.
+const size_t kMinSkipSearchSize = 64;
+
+template<typename Iterator, typename Category, typename Key>
+inline Iterator find_subrange(Iterator iBegin, Iterator iEnd, Iterator iPatternBegin, Iterator iPatternEnd,
+		Category, Key)
 {
-	typename Range::iterator aPfxIt = common_prefix(ioRng1.begin(), ioRng1.end(), ioRng2.begin(), ioRng2.end());
-	if(aPfxIt != ioRng1.begin())
+	return std::search(iBegin, iEnd, iPatternBegin, iPatternEnd);
+}
+
+/*! Boyer-Moore-Horspool search of random access ranges of integral elements.
+ *
+ * Elements sharing their lowest byte share a skip table entry, which keeps
+ * the shorter shift and the search exact.
+ */
+template<typename Iterator>
+inline Iterator find_subrange(Iterator iBegin, Iterator iEnd, Iterator iPatternBegin, Iterator iPatternEnd,
+		std::random_access_iterator_tag, keyed_element)
+{
+	const size_t aSize = iEnd - iBegin;
+	const size_t aPatternSize = iPatternEnd - iPatternBegin;
+	if((aSize < kMinSkipSearchSize) || (aPatternSize < 2) || (aPatternSize > aSize))
 	{
-		oCommonPfx = Range(ioRng1.begin(), aPfxIt);
-		ioRng1.erase(ioRng1.begin(), aPfxIt);
-		ioRng2.erase(ioRng2.begin(), next(ioRng2.begin(), oCommonPfx.size()));
+		return std::search(iBegin, iEnd, iPatternBegin, iPatternEnd);
 	}
-	typename Range::iterator aSfxIt = common_suffix(ioRng1.begin(), ioRng1.end(), ioRng2.begin(), ioRng2.end());
-	if(aSfxIt != ioRng1.end())
+
+	size_t aShifts[256];
+	std::fill(aShifts, aShifts + 256, aPatternSize);
+	for(size_t anIndex = 0; anIndex < aPatternSize - 1; ++anIndex)
 	{
-		oCommonSfx = Range(aSfxIt, ioRng1.end());
-		ioRng1.erase(aSfxIt, ioRng1.end());
-		ioRng2.erase(prior(ioRng2.end(), oCommonSfx.size()), ioRng2.end());
+		aShifts[static_cast<unsigned char>(iPatternBegin[anIndex])] = aPatternSize - 1 - anIndex;
 	}
+
+	const Iterator aPatternLastIt = iPatternEnd - 1;
+	for(size_t aLast = aPatternSize - 1; aLast < aSize; aLast += aShifts[static_cast<unsigned char>(iBegin[aLast])])
+	{
+		const Iterator aFoundIt = iBegin + (aLast - (aPatternSize - 1));
+		if((iBegin[aLast] == *aPatternLastIt) && std::equal(iPatternBegin, aPatternLastIt, aFoundIt))
+		{
+			return aFoundIt;
+		}
+	}
+	return iEnd;
+}
+
+/*! Finds the first occurrence of the pattern in the range.
+ *
+ * @return beginning of the occurrence or iEnd
+ */
+template<typename Iterator>
+inline Iterator find_subrange(Iterator iBegin, Iterator iEnd, Iterator iPatternBegin, Iterator iPatternEnd)
+{
+	return find_subrange(iBegin, iEnd, iPatternBegin, iPatternEnd,
+			typename std::iterator_traits<Iterator>::iterator_category(),
+			typename element_key<typename std::iterator_traits<Iterator>::value_type>::type());
+}
+
+template<typename Iterator>
+inline bool equal(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2)
+{
+	return (std::distance(iBegin1, iEnd1) == std::distance(iBegin2, iEnd2)) &&
+			std::equal(iBegin1, iEnd1, iBegin2);
 }
 
 template<typename Iterator>
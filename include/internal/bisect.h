@@ -2,31 +2,36 @@
 #define DIFF_BISECT_H_
 
 #include <iostream>
+#include <vector>
 
 #include "algorithm.h"
 #include "range_traits.h"
 #include "operation.h"
+#include "types.h"
 
 namespace izi {
 namespace diff {
 namespace detail {
 
 template<typename Traits, typename Iterator, typename Result>
-void calculate(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult);
+void calculate_hunks(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult,
+		const options& iOptions);
 
 template<typename Iterator, typename Result>
 inline void bisect_split(Iterator iBegin1, Iterator iMid1, Iterator iEnd1,
 		Iterator iBegin2, Iterator iMid2, Iterator iEnd2,
-		Result& oResult)
+		Result& oResult, const options& iOptions)
 {
-	calculate<void_traits>(iBegin1, iMid1, iBegin2, iMid2, oResult);
-	calculate<void_traits>(iMid1, iEnd1, iMid2, iEnd2, oResult);
+	calculate_hunks<void_traits>(iBegin1, iMid1, iBegin2, iMid2, oResult, iOptions);
+	calculate_hunks<void_traits>(iMid1, iEnd1, iMid2, iEnd2, oResult, iOptions);
 }
 
 template<typename Iterator, typename Result>
-void bisect(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult)
+void bisect(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult, const options& iOptions)
 {
 	typedef typename Result::value_type::second_type range_type;
+	typedef typename rebind_allocator<typename Result::allocator_type, int>::type int_allocator;
+	typedef std::vector<int, int_allocator> v_type;
 
 	// Cache the text lengths to prevent multiple calls.
 	const size_t aRng1Size = std::distance(iBegin1, iEnd1);
@@ -34,13 +39,8 @@ void bisect(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2,
 	const size_t max_d = (aRng1Size + aRng2Size + 1) / 2;
 	const int v_offset = max_d;
 	const int v_length = 2 * max_d;
-	int *v1 = new int[v_length];
-	int *v2 = new int[v_length];
-	for (int x = 0; x < v_length; x++)
-	{
-		v1[x] = -1;
-		v2[x] = -1;
-	}
+	v_type v1(v_length, -1, int_allocator(oResult.get_allocator()));
+	v_type v2(v_length, -1, int_allocator(oResult.get_allocator()));
 	v1[v_offset + 1] = 0;
 	v2[v_offset + 1] = 0;
 	const int delta = aRng1Size - aRng2Size;
@@ -94,10 +94,10 @@ void bisect(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2,
 					int x2 = aRng1Size - v2[k2_offset];
 					if (x1 >= x2)
 					{
-						// Overlap detected.
-						delete [] v1;
-						delete [] v2;
-						bisect_split(iBegin1, iBegin1+x1, iEnd1, iBegin2, iBegin2+y1, iEnd2, oResult);
+						// Overlap detected, free the paths before recursing.
+						v_type(v1.get_allocator()).swap(v1);
+						v_type(v2.get_allocator()).swap(v2);
+						bisect_split(iBegin1, iBegin1+x1, iEnd1, iBegin2, iBegin2+y1, iEnd2, oResult, iOptions);
 						return;
 					}
 				}
@@ -145,19 +145,16 @@ void bisect(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2,
 					x2 = aRng1Size - x2;
 					if (x1 >= x2)
 					{
-						// Overlap detected.
-						delete [] v1;
-						delete [] v2;
-						bisect_split(iBegin1, iBegin1+x1, iEnd1, iBegin2, iBegin2+y1, iEnd2, oResult);
+						// Overlap detected, free the paths before recursing.
+						v_type(v1.get_allocator()).swap(v1);
+						v_type(v2.get_allocator()).swap(v2);
+						bisect_split(iBegin1, iBegin1+x1, iEnd1, iBegin2, iBegin2+y1, iEnd2, oResult, iOptions);
 						return;
 					}
 				}
 			}
 		}
 	}
-	delete [] v1;
-	delete [] v2;
-
 	oResult.push_back(std::make_pair(operation::remove(), range_type(iBegin1, iEnd1)));
 	oResult.push_back(std::make_pair(operation::insert(), range_type(iBegin2, iEnd2)));
 }
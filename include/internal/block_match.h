@@ -0,0 +1,260 @@
+#ifndef IZI_DIFF_BLOCK_MATCH_H_
+#define IZI_DIFF_BLOCK_MATCH_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "algorithm.h"
+#include "operation.h"
+#include "range_traits.h"
+#include "types.h"
+
+namespace izi {
+namespace diff {
+namespace detail {
+
+template<typename Traits, typename Iterator, typename Result>
+void calculate_hunks(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult,
+		const options& iOptions);
+
+//! Size from which byte ranges are diffed around matching blocks.
+const size_t kBlockMatchMinSize = 1 << 20;
+
+//! Smallest block matched, blocks are otherwise the square root of the first range.
+const size_t kMinBlockSize = 64;
+
+/*! Weak checksum of rsync over a window of bytes, rolled by one byte in
+ *  constant time.
+ */
+class rolling_checksum
+{
+public:
+	rolling_checksum(): _a(0), _b(0) {}
+
+	template<typename Iterator>
+	void reset(Iterator iBegin, size_t iSize)
+	{
+		_a = 0;
+		_b = 0;
+		for(size_t anIndex = iSize; anIndex > 0; --anIndex, ++iBegin)
+		{
+			const unsigned long aByte = static_cast<unsigned char>(*iBegin);
+			_a += aByte;
+			_b += anIndex * aByte;
+		}
+	}
+
+	//! Moves the window of iSize bytes past iOut to include iIn.
+	void roll(unsigned char iOut, unsigned char iIn, size_t iSize)
+	{
+		_a += static_cast<unsigned long>(iIn) - iOut;
+		_b += _a - iSize * iOut;
+	}
+
+	unsigned long value() const
+	{
+		return (_a & 0xFFFF) | ((_b & 0xFFFF) << 16);
+	}
+
+private:
+	unsigned long _a;
+	unsigned long _b;
+};
+
+/*! rsync like front end of the calculation for large byte ranges.
+ *
+ * Blocks of the first range are indexed by their weak checksum, the window
+ * rolled over the second range looks them up at every position, a
+ * candidate is confirmed by comparing the bytes. Matches are taken greedily
+ * in increasing order in both ranges and extended to both sides, only the
+ * gaps between them are diffed. The diff found may not be minimal.
+ *
+ * Checksums are looked up in an open addressing hash table, in constant
+ * expected time, so the scan is linear in the size of the ranges. Only
+ * blocks sharing a checksum, e.g. runs of zeros, are searched by position
+ * in logarithmic time. Sorting the blocks is O(b log b) for b blocks.
+ */
+template<typename Traits, typename Iterator, bool Byte = byte_element<typename std::iterator_traits<Iterator>::value_type>::value>
+class block_matcher
+{
+public:
+	template<typename Result>
+	static bool calculate(Iterator, Iterator, Iterator, Iterator, Result&, const options&, size_t)
+	{
+		return false;
+	}
+};
+
+template<typename Traits, typename Iterator>
+class block_matcher<Traits, Iterator, true>
+{
+public:
+	/*! @param iBlockSize size of the blocks of the first range
+	 *  @return false if no block matched, nothing is appended then
+	 */
+	template<typename Result>
+	static bool calculate(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult,
+			const options& iOptions, size_t iBlockSize)
+	{
+		typedef typename Result::value_type::second_type range_type;
+		typedef std::pair<unsigned long, size_t> block_type;
+		typedef std::vector<block_type>::const_iterator block_iterator;
+		typedef std::pair<size_t, size_t> run_type;
+
+		const size_t aSize1 = std::distance(iBegin1, iEnd1);
+		const size_t aSize2 = std::distance(iBegin2, iEnd2);
+		if((iBlockSize == 0) || (aSize1 < iBlockSize) || (aSize2 < iBlockSize))
+		{
+			return false;
+		}
+
+		// Blocks sorted by checksum then position
+		std::vector<block_type> aBlocks(aSize1 / iBlockSize);
+		rolling_checksum aChecksum;
+		for(size_t aBlock = 0; aBlock < aBlocks.size(); ++aBlock)
+		{
+			aChecksum.reset(detail::next(iBegin1, aBlock * iBlockSize), iBlockSize);
+			aBlocks[aBlock] = block_type(aChecksum.value(), aBlock);
+		}
+		std::sort(aBlocks.begin(), aBlocks.end());
+
+		// Runs of blocks with the same checksum as [begin, end) in aBlocks,
+		// empty slots hold empty runs
+		size_t aMask(1);
+		while(aMask < 2 * aBlocks.size())
+		{
+			aMask <<= 1;
+		}
+		--aMask;
+		std::vector<run_type> aTable(aMask + 1, run_type(0, 0));
+		for(size_t aRunBegin = 0; aRunBegin < aBlocks.size(); )
+		{
+			size_t aRunEnd = aRunBegin + 1;
+			while((aRunEnd < aBlocks.size()) && (aBlocks[aRunEnd].first == aBlocks[aRunBegin].first))
+			{
+				++aRunEnd;
+			}
+			size_t aSlot = checksum_slot(aBlocks[aRunBegin].first, aMask);
+			while(aTable[aSlot].first != aTable[aSlot].second)
+			{
+				aSlot = (aSlot + 1) & aMask;
+			}
+			aTable[aSlot] = run_type(aRunBegin, aRunEnd);
+			aRunBegin = aRunEnd;
+		}
+
+		bool aMatched(false);
+		size_t aPos1(0);
+		size_t aPos2(0);
+		size_t aNextBlock(0);
+		size_t aWindow(0);
+		aChecksum.reset(iBegin2, iBlockSize);
+		while(aWindow + iBlockSize <= aSize2)
+		{
+			const Iterator aWindowIt = detail::next(iBegin2, aWindow);
+			const unsigned long aValue = aChecksum.value();
+			size_t aSlot = checksum_slot(aValue, aMask);
+			while((aTable[aSlot].first != aTable[aSlot].second) && (aBlocks[aTable[aSlot].first].first != aValue))
+			{
+				aSlot = (aSlot + 1) & aMask;
+			}
+			const block_iterator aRunEnd = aBlocks.begin() + aTable[aSlot].second;
+			block_iterator aBlockIt = aBlocks.begin() + aTable[aSlot].first;
+			if((aBlockIt != aRunEnd) && (aBlockIt->second < aNextBlock))
+			{
+				aBlockIt = std::lower_bound(aBlockIt, aRunEnd, block_type(aValue, aNextBlock));
+			}
+			for(; aBlockIt != aRunEnd; ++aBlockIt)
+			{
+				if(std::equal(aWindowIt, detail::next(aWindowIt, iBlockSize), detail::next(iBegin1, aBlockIt->second * iBlockSize)))
+				{
+					break;
+				}
+			}
+
+			if(aBlockIt == aRunEnd)
+			{
+				if(aWindow + iBlockSize == aSize2)
+				{
+					break;
+				}
+				aChecksum.roll(*aWindowIt, *detail::next(aWindowIt, iBlockSize), iBlockSize);
+				++aWindow;
+				continue;
+			}
+
+			// Extends the block over the gaps before and after it
+			const Iterator aBlockBegin1 = detail::next(iBegin1, aBlockIt->second * iBlockSize);
+			const size_t aBefore = std::distance(common_suffix(detail::next(iBegin1, aPos1), aBlockBegin1,
+					detail::next(iBegin2, aPos2), aWindowIt), aBlockBegin1);
+			const Iterator aBlockEnd1 = detail::next(aBlockBegin1, iBlockSize);
+			const size_t anAfter = std::distance(aBlockEnd1, common_prefix(aBlockEnd1, iEnd1,
+					detail::next(aWindowIt, iBlockSize), iEnd2));
+			const size_t anEqual1 = aBlockIt->second * iBlockSize - aBefore;
+			const size_t anEqual2 = aWindow - aBefore;
+			const size_t anEqualSize = aBefore + iBlockSize + anAfter;
+
+			if((aPos1 != anEqual1) || (aPos2 != anEqual2))
+			{
+				calculate_hunks<Traits>(detail::next(iBegin1, aPos1), detail::next(iBegin1, anEqual1),
+						detail::next(iBegin2, aPos2), detail::next(iBegin2, anEqual2), oResult, iOptions);
+			}
+			oResult.push_back(std::make_pair(operation::equal(),
+					range_type(detail::next(iBegin1, anEqual1), detail::next(iBegin1, anEqual1 + anEqualSize))));
+			aMatched = true;
+			aPos1 = anEqual1 + anEqualSize;
+			aPos2 = anEqual2 + anEqualSize;
+			aNextBlock = (aPos1 + iBlockSize - 1) / iBlockSize;
+			aWindow = aPos2;
+			if(aWindow + iBlockSize <= aSize2)
+			{
+				aChecksum.reset(detail::next(iBegin2, aWindow), iBlockSize);
+			}
+		}
+
+		if(aMatched && ((aPos1 != aSize1) || (aPos2 != aSize2)))
+		{
+			calculate_hunks<Traits>(detail::next(iBegin1, aPos1), iEnd1, detail::next(iBegin2, aPos2), iEnd2,
+					oResult, iOptions);
+		}
+		return aMatched;
+	}
+
+private:
+	static size_t checksum_slot(unsigned long iValue, size_t iMask)
+	{
+		return static_cast<size_t>(((iValue ^ (iValue >> 15)) * 2654435761UL) >> 7) & iMask;
+	}
+};
+
+/*! Diffs large byte ranges around blocks of the first range found in the
+ *  second one, see block_matcher.
+ *
+ * Only used for ranges of at least kBlockMatchMinSize bytes, blocks are the
+ * square root of the first range. Skipped for minimal options.
+ *
+ * @return false if the ranges are not handled, nothing is appended then
+ */
+template<typename Traits, typename Iterator, typename Result>
+bool block_match(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult,
+		const options& iOptions)
+{
+	const size_t aSize1 = std::distance(iBegin1, iEnd1);
+	if(iOptions._minimal || (aSize1 < kBlockMatchMinSize) ||
+			(static_cast<size_t>(std::distance(iBegin2, iEnd2)) < kBlockMatchMinSize))
+	{
+		return false;
+	}
+	const size_t aBlockSize = std::max(kMinBlockSize, static_cast<size_t>(std::sqrt(static_cast<double>(aSize1))));
+	return block_matcher<Traits, Iterator>::calculate(iBegin1, iEnd1, iBegin2, iEnd2, oResult, iOptions, aBlockSize);
+}
+
+}  // namespace detail
+}  // namespace diff
+}  // namespace izi
+
+#endif /* IZI_DIFF_BLOCK_MATCH_H_ */
@@ -4,7 +4,9 @@
 #include <iostream>
 
 #include "bisect.h"
+#include "block_match.h"
 #include "cleanup.h"
+#include "half_match.h"
 #include "line_transformation.h"
 #include "operation.h"
 
@@ -13,21 +15,23 @@ namespace diff {
 namespace detail {
 
 template<typename Traits, typename Iterator, typename Result>
-void calculate(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult, const non_line_range&)
+void calculate(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult, const options& iOptions,
+		const non_line_range&)
 {
-	bisect(iBegin1, iEnd1, iBegin2, iEnd2, oResult);
+	bisect(iBegin1, iEnd1, iBegin2, iEnd2, oResult, iOptions);
 }
 
 template<typename Traits, typename Iterator, typename Result>
-void calculate(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult, const line_range&)
+void calculate(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult, const options& iOptions,
+		const line_range&)
 {
 	if((std::distance(iBegin1, iEnd1) > Traits::min_size()) && (std::distance(iBegin2, iEnd2) > Traits::min_size()))
 	{
-		line_diff<Traits>(iBegin1, iEnd1, iBegin2, iEnd2, oResult);
+		line_diff<Traits>(iBegin1, iEnd1, iBegin2, iEnd2, oResult, iOptions);
 	}
 	else
 	{
-		bisect(iBegin1, iEnd1, iBegin2, iEnd2, oResult);
+		bisect(iBegin1, iEnd1, iBegin2, iEnd2, oResult, iOptions);
 	}
 }
 
@@ -69,7 +73,7 @@ bool check_subrange(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator
 	Iterator aLongEnd(aFirstLonger ? iEnd1 : iEnd2);
 	const size_t aShortSize(std::distance(aShortBegin, aShortEnd));
 
-	Iterator anIt = std::search(aLongBegin, aLongEnd, aShortBegin, aShortEnd);
+	Iterator anIt = find_subrange(aLongBegin, aLongEnd, aShortBegin, aShortEnd);
 	if(anIt != aLongEnd)
 	{
 		const operation anOperation(aFirstLonger ? operation::remove() : operation::insert());
@@ -118,8 +122,14 @@ Iterator check_pfx_sfx(Iterator& ioBegin1, Iterator& ioEnd1, Iterator& ioBegin2,
 	return aSfxIt;
 }
 
+/*! Appends hunks of the diff to the result without normalising them.
+ *
+ * Recursive steps of the calculation only append, the hunks are normalised
+ * once by calculate() for the whole result.
+ */
 template<typename Traits, typename Iterator, typename Result>
-void calculate(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult)
+void calculate_hunks(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult,
+		const options& iOptions)
 {
 	typedef typename Result::value_type::second_type range_type;
 
@@ -140,10 +150,12 @@ void calculate(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd
 		Iterator aSfxIt = check_pfx_sfx(aBegin1, aEnd1, aBegin2, aEnd2, oResult);
 
 		if(!check_empty(aBegin1, aEnd1, aBegin2, aEnd2, oResult) &&
-				!check_subrange(aBegin1, aEnd1, aBegin2, aEnd2, oResult))
+				!check_subrange(aBegin1, aEnd1, aBegin2, aEnd2, oResult) &&
+				!block_match<Traits>(aBegin1, aEnd1, aBegin2, aEnd2, oResult, iOptions) &&
+				!half_match<Traits>(aBegin1, aEnd1, aBegin2, aEnd2, oResult, iOptions))
 		{
 			// Perform a real diff.
-			calculate<Traits>(aBegin1, aEnd1, aBegin2, aEnd2, oResult, typename Traits::range_type());
+			calculate<Traits>(aBegin1, aEnd1, aBegin2, aEnd2, oResult, iOptions, typename Traits::range_type());
 		}
 
 		// Push the common suffix to the result
@@ -151,8 +163,6 @@ void calculate(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd
 		{
 			oResult.push_back(std::make_pair(operation::equal(), range_type(aSfxIt, iEnd1)));
 		}
-
-		cleanup(oResult);
 	}
 	else
 	{
@@ -160,6 +170,22 @@ void calculate(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd
 	}
 }
 
+template<typename Traits, typename Iterator, typename Result>
+void calculate(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult,
+		const options& iOptions, stats& oStats)
+{
+	calculate_hunks<Traits>(iBegin1, iEnd1, iBegin2, iEnd2, oResult, iOptions);
+	cleanup(oResult, oStats);
+}
+
+template<typename Traits, typename Iterator, typename Result>
+void calculate(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult,
+		const options& iOptions)
+{
+	stats aStats;
+	calculate<Traits>(iBegin1, iEnd1, iBegin2, iEnd2, oResult, iOptions, aStats);
+}
+
 }  // namespace detail
 }  // namespace diff
 }  // namespace izi
@@ -0,0 +1,308 @@
+#ifndef IZI_DIFF_CHUNKING_H_
+#define IZI_DIFF_CHUNKING_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <list>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "cleanup.h"
+#include "operation.h"
+#include "range_traits.h"
+#include "types.h"
+
+namespace izi {
+namespace diff {
+namespace detail {
+
+template<typename Traits, typename Iterator, typename Result>
+void calculate_hunks(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult,
+		const options& iOptions);
+
+//! Chunks are cut after at least kMinChunkSize bytes...
+const size_t kMinChunkSize = 2048;
+
+//! ...and at most kMaxChunkSize bytes.
+const size_t kMaxChunkSize = 65536;
+
+//! Bits of the Gear hash cutting a chunk when clear, 13 for 8 KiB chunks on average.
+const unsigned long kChunkMask = 0xFFF80000UL;
+
+//! Size from which ranges are diffed by chunks.
+const size_t kChunkedMinSize = 4 * kMaxChunkSize;
+
+/*! Content defined chunks of bytes cut by a Gear hash, as in FastCDC.
+ *
+ * The hash of a position only depends on the 32 bytes before it, so
+ * boundaries resynchronise shortly after an edit and unchanged content
+ * is cut into the same chunks in both ranges.
+ */
+class gear_chunker
+{
+public:
+	gear_chunker()
+	{
+		// Fixed pseudo random table, both ranges must be cut the same way
+		unsigned long aSeed(0x9E3779B9UL);
+		for(size_t anIndex = 0; anIndex < 256; ++anIndex)
+		{
+			aSeed = (aSeed * 1103515245UL + 12345UL) & 0xFFFFFFFFUL;
+			_table[anIndex] = aSeed ^ (aSeed >> 15);
+			aSeed = (aSeed * 1103515245UL + 12345UL) & 0xFFFFFFFFUL;
+			_table[anIndex] ^= aSeed << 16;
+		}
+	}
+
+	//! End of the chunk starting at iBegin.
+	template<typename Iterator>
+	Iterator chunk_end(Iterator iBegin, Iterator iEnd) const
+	{
+		const size_t aSize = std::distance(iBegin, iEnd);
+		if(aSize <= kMinChunkSize)
+		{
+			return iEnd;
+		}
+		const Iterator aLastIt = detail::next(iBegin, std::min(aSize, kMaxChunkSize));
+		unsigned long aHash(0);
+		for(Iterator anIt = detail::next(iBegin, kMinChunkSize); anIt != aLastIt; ++anIt)
+		{
+			aHash = (aHash << 1) + _table[static_cast<unsigned char>(*anIt)];
+			if((aHash & kChunkMask) == 0)
+			{
+				return detail::next(anIt);
+			}
+		}
+		return aLastIt;
+	}
+
+	//! Appends the beginnings of the chunks of the range, its end included.
+	template<typename Iterator, typename Positions>
+	void split(Iterator iBegin, Iterator iEnd, Positions& oPositions) const
+	{
+		while(iBegin != iEnd)
+		{
+			oPositions.push_back(iBegin);
+			iBegin = chunk_end(iBegin, iEnd);
+		}
+		oPositions.push_back(iEnd);
+	}
+
+private:
+	unsigned long _table[256];
+};
+
+/*! Indices of the chunks, the same for equal chunks of both ranges.
+ *
+ * Chunks are looked up by size and a hash of their content, a collision
+ * with different content gets an index of its own.
+ */
+template<typename Iterator, typename Positions>
+void chunk_indices(const Positions& iPositions, std::map<std::pair<size_t, unsigned long>, std::pair<Iterator, line_index> >& ioChunks,
+		line_index& ioNextIndex, std::vector<line_index>& oIndices)
+{
+	typedef std::map<std::pair<size_t, unsigned long>, std::pair<Iterator, line_index> > chunk_map;
+
+	for(size_t aChunk = 0; aChunk + 1 < iPositions.size(); ++aChunk)
+	{
+		const Iterator aBegin = iPositions[aChunk];
+		const Iterator anEnd = iPositions[aChunk + 1];
+		unsigned long aHash(2166136261UL);
+		for(Iterator anIt = aBegin; anIt != anEnd; ++anIt)
+		{
+			aHash = ((aHash ^ static_cast<unsigned char>(*anIt)) * 16777619UL) & 0xFFFFFFFFUL;
+		}
+
+		const size_t aSize = std::distance(aBegin, anEnd);
+		const std::pair<typename chunk_map::iterator, bool> anInserted = ioChunks.insert(std::make_pair(
+				std::make_pair(aSize, aHash), std::make_pair(aBegin, ioNextIndex)));
+		if(anInserted.second)
+		{
+			oIndices.push_back(ioNextIndex++);
+		}
+		else if(std::equal(aBegin, anEnd, anInserted.first->second.first))
+		{
+			oIndices.push_back(anInserted.first->second.second);
+		}
+		else
+		{
+			oIndices.push_back(ioNextIndex++);
+		}
+	}
+}
+
+//! Chunks of both ranges differing between two runs of equal chunks.
+template<typename Iterator, typename Result>
+struct chunk_change
+{
+	chunk_change(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, const Result& iDiff):
+		_begin1(iBegin1), _end1(iEnd1), _begin2(iBegin2), _end2(iEnd2), _diff(iDiff) {}
+
+	Iterator _begin1;
+	Iterator _end1;
+	Iterator _begin2;
+	Iterator _end2;
+	Result _diff;
+};
+
+template<typename Traits>
+class chunk_change_task
+{
+public:
+	explicit chunk_change_task(const options& iOptions): _options(&iOptions) {}
+
+	template<typename Change>
+	void operator()(Change& ioChange) const
+	{
+		calculate_hunks<Traits>(ioChange._begin1, ioChange._end1, ioChange._begin2, ioChange._end2,
+				ioChange._diff, *_options);
+	}
+
+private:
+	const options* _options;
+};
+
+/*! Diff by content defined chunks, changed chunks are diffed by the executor.
+ *
+ * Both ranges are cut into chunks and the sequences of their indices are
+ * diffed first. Runs of equal chunks are equalities, the chunks between
+ * them are diffed as separate tasks whose hunks are spliced in order. The
+ * tasks share the result's allocator, which must be thread safe for a
+ * concurrent executor.
+ */
+template<typename Traits, typename Iterator, bool Byte = byte_element<typename std::iterator_traits<Iterator>::value_type>::value>
+class chunked_calculation
+{
+public:
+	template<typename Result, typename Executor>
+	static bool calculate(Iterator, Iterator, Iterator, Iterator, Result&, const Executor&, const options&)
+	{
+		return false;
+	}
+};
+
+template<typename Traits, typename Iterator>
+class chunked_calculation<Traits, Iterator, true>
+{
+public:
+	/*! @return false if the ranges are too short to be split, nothing is
+	 *  appended then
+	 */
+	template<typename Result, typename Executor>
+	static bool calculate(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult,
+			const Executor& iExecutor, const options& iOptions)
+	{
+		typedef typename Result::value_type::second_type range_type;
+		typedef chunk_change<Iterator, Result> change_type;
+		typedef typename rebind_allocator<typename Result::allocator_type, change_type>::type change_allocator;
+		typedef std::vector<line_index>::const_iterator index_iterator;
+		typedef std::list<std::pair<operation, range<index_iterator> > > index_diff;
+
+		if((static_cast<size_t>(std::distance(iBegin1, iEnd1)) < kChunkedMinSize) ||
+				(static_cast<size_t>(std::distance(iBegin2, iEnd2)) < kChunkedMinSize))
+		{
+			return false;
+		}
+
+		const gear_chunker aChunker;
+		std::vector<Iterator> aPositions1;
+		std::vector<Iterator> aPositions2;
+		aChunker.split(iBegin1, iEnd1, aPositions1);
+		aChunker.split(iBegin2, iEnd2, aPositions2);
+
+		std::map<std::pair<size_t, unsigned long>, std::pair<Iterator, line_index> > aChunks;
+		line_index aNextIndex(0);
+		std::vector<line_index> anIndices1;
+		std::vector<line_index> anIndices2;
+		chunk_indices(aPositions1, aChunks, aNextIndex, anIndices1);
+		chunk_indices(aPositions2, aChunks, aNextIndex, anIndices2);
+
+		index_diff aChunkDiff;
+		const std::vector<line_index>& aConstIndices1(anIndices1);
+		const std::vector<line_index>& aConstIndices2(anIndices2);
+		calculate_hunks<void_traits>(aConstIndices1.begin(), aConstIndices1.end(), aConstIndices2.begin(),
+				aConstIndices2.end(), aChunkDiff, iOptions);
+
+		// Equal runs as (position in the first range, chunk count), changes
+		// as the index of their task with no chunk
+		std::vector<std::pair<size_t, size_t> > aParts;
+		std::vector<change_type, change_allocator> aChanges((change_allocator(oResult.get_allocator())));
+		size_t aChunk1(0);
+		size_t aChunk2(0);
+		size_t aChangeChunk1(0);
+		size_t aChangeChunk2(0);
+		for(typename index_diff::const_iterator aHunkIt = aChunkDiff.begin(); ; ++aHunkIt)
+		{
+			const bool anEnd = (aHunkIt == aChunkDiff.end());
+			if((anEnd || aHunkIt->first.isEqual()) && ((aChangeChunk1 != aChunk1) || (aChangeChunk2 != aChunk2)))
+			{
+				aParts.push_back(std::make_pair(aChanges.size(), size_t(0)));
+				aChanges.push_back(change_type(aPositions1[aChangeChunk1], aPositions1[aChunk1],
+						aPositions2[aChangeChunk2], aPositions2[aChunk2], Result(oResult.get_allocator())));
+			}
+			if(anEnd)
+			{
+				break;
+			}
+
+			const size_t aSize = aHunkIt->second.size();
+			if(aHunkIt->first.isEqual())
+			{
+				aParts.push_back(std::make_pair(aChunk1, aSize));
+				aChunk1 += aSize;
+				aChunk2 += aSize;
+				aChangeChunk1 = aChunk1;
+				aChangeChunk2 = aChunk2;
+			}
+			else if(aHunkIt->first.isRemove())
+			{
+				aChunk1 += aSize;
+			}
+			else
+			{
+				aChunk2 += aSize;
+			}
+		}
+
+		iExecutor.for_each(aChanges.begin(), aChanges.end(), chunk_change_task<Traits>(iOptions));
+
+		for(std::vector<std::pair<size_t, size_t> >::const_iterator aPartIt = aParts.begin(); aPartIt != aParts.end(); ++aPartIt)
+		{
+			if(aPartIt->second == 0)
+			{
+				oResult.splice(oResult.end(), aChanges[aPartIt->first]._diff);
+			}
+			else
+			{
+				oResult.push_back(std::make_pair(operation::equal(),
+						range_type(aPositions1[aPartIt->first], aPositions1[aPartIt->first + aPartIt->second])));
+			}
+		}
+		return true;
+	}
+};
+
+/*! Diff of large byte ranges by content defined chunks through the
+ *  executor, normalised like calculate() with the statistics in oStats.
+ *
+ * Ranges of other elements or shorter than kChunkedMinSize are diffed
+ * as usual in the calling thread.
+ */
+template<typename Traits, typename Iterator, typename Result, typename Executor>
+void calculate_chunked(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult,
+		const Executor& iExecutor, const options& iOptions, stats& oStats)
+{
+	if(!chunked_calculation<Traits, Iterator>::calculate(iBegin1, iEnd1, iBegin2, iEnd2, oResult, iExecutor, iOptions))
+	{
+		calculate_hunks<Traits>(iBegin1, iEnd1, iBegin2, iEnd2, oResult, iOptions);
+	}
+	cleanup(oResult, oStats);
+}
+
+}  // namespace detail
+}  // namespace diff
+}  // namespace izi
+
+#endif /* IZI_DIFF_CHUNKING_H_ */
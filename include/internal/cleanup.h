@@ -4,162 +4,442 @@
 #include <algorithm>
 
 #include "algorithm.h"
+#include "operation.h"
+#include "stats.h"
 #include "types.h"
 
 namespace izi {
 namespace diff {
 namespace detail {
 
-template<typename Result>
-void cleanup(Result& ioResult);
+//! Equality with the sizes of the edits between it and the previous one.
+template<typename Iterator>
+struct equality_entry
+{
+	equality_entry(Iterator iIt, size_t iInsertSize, size_t iRemoveSize):
+		_it(iIt), _insertSize(iInsertSize), _removeSize(iRemoveSize) {}
 
+	Iterator _it;
+	size_t _insertSize;
+	size_t _removeSize;
+};
+
+//! Adds the statistics of the hunks [iBegin, iEnd) in order.
+template<typename Iterator>
+void add_hunks(stats& ioStats, Iterator iBegin, Iterator iEnd)
+{
+	for(; iBegin != iEnd; ++iBegin)
+	{
+		ioStats.add(iBegin->first, iBegin->second.size());
+	}
+}
+
+//! Statistics of the hunks [iBegin, iEnd).
+template<typename Iterator>
+stats hunk_stats(Iterator iBegin, Iterator iEnd)
+{
+	stats aStats;
+	add_hunks(aStats, iBegin, iEnd);
+	return aStats;
+}
+
+/*! Inserts new hunk before the position taking over the content of the range,
+ *  the range is left empty.
+ */
 template<typename Result>
-void cleanup_first_pass(Result& ioResult)
+typename Result::iterator insert_swapped(Result& ioResult, typename Result::iterator iPosition,
+		const operation& iOperation, typename Result::value_type::second_type& ioRange)
 {
 	typedef typename Result::value_type::second_type range_type;
 
-	// Put dummy equality to the end, so we trigger cleanup at least once
-	ioResult.push_back(std::make_pair(operation::equal(), range_type()));
+	typename Result::iterator anIt = ioResult.insert(iPosition, std::make_pair(iOperation, range_type(ioResult.get_allocator())));
+	anIt->second.swap(ioRange);
+	return anIt;
+}
+
+/*! Keeps the elements of the range between iPfxSize first and iSfxSize
+ *  last ones.
+ *
+ * Only the end of the range is truncated when there is no prefix, otherwise
+ * the kept elements are copied once into a new range instead of shifting them.
+ */
+template<typename Range, typename Allocator>
+void keep_middle(Range& ioRange, size_t iPfxSize, size_t iSfxSize, const Allocator& iAllocator)
+{
+	if(iPfxSize == 0)
+	{
+		ioRange.erase(detail::prior(ioRange.end(), iSfxSize), ioRange.end());
+		return;
+	}
+	Range aMiddle(iAllocator);
+	aMiddle.assign(detail::next(ioRange.begin(), iPfxSize), detail::prior(ioRange.end(), iSfxSize));
+	ioRange.swap(aMiddle);
+}
 
-	size_t aInsertedCnt(0);
-	range_type aInserted;
-	size_t aRemovedCnt(0);
-	range_type aRemoved;
+/*! Normalises the change block between two equalities.
+ *
+ * Block is already reduced to at most one removal and one insertion. Their
+ * common prefix and suffix are found as sizes first. The prefix is appended
+ * to the previous equality, the next equality is rebuilt once as the suffix
+ * followed by its elements, and the removal and insertion keep their middle.
+ * No range is shifted, elements are only appended or truncated at the end.
+ *
+ * @param iEqualIt equality before the block or end
+ * @param iRemoveIt removal of the block or end
+ * @param iInsertIt insertion of the block or end
+ * @param iNextIt equality after the block or end
+ * @return last equality up to the end of the block
+ */
+template<typename Result>
+typename Result::iterator cleanup_block(Result& ioResult, typename Result::iterator iEqualIt,
+		typename Result::iterator iRemoveIt, typename Result::iterator iInsertIt,
+		typename Result::iterator iNextIt)
+{
+	typedef typename Result::value_type::second_type range_type;
+	typedef typename Result::iterator iterator;
 
-	typename Result::iterator aResultIt = ioResult.begin();
-	while(aResultIt != ioResult.end())
+	const iterator anEnd = ioResult.end();
+	if((iRemoveIt != anEnd) && (iInsertIt != anEnd))
 	{
-		if(aResultIt->first.isInsert())
+		// Removal goes first
+		if(detail::next(iInsertIt) == iRemoveIt)
 		{
-			++aInsertedCnt;
-			std::copy(aResultIt->second.begin(), aResultIt->second.end(), std::back_inserter(aInserted));
+			ioResult.splice(iInsertIt, ioResult, iRemoveIt);
 		}
-		else if(aResultIt->first.isRemove())
+		range_type& aRemoved = iRemoveIt->second;
+		range_type& anInserted = iInsertIt->second;
+
+		const size_t aPfxSize = std::distance(aRemoved.begin(),
+				common_prefix(aRemoved.begin(), aRemoved.end(), anInserted.begin(), anInserted.end()));
+		const size_t aSfxSize = std::distance(common_suffix(detail::next(aRemoved.begin(), aPfxSize), aRemoved.end(),
+				detail::next(anInserted.begin(), aPfxSize), anInserted.end()), aRemoved.end());
+
+		if((aPfxSize + aSfxSize == aRemoved.size()) && (aPfxSize + aSfxSize == anInserted.size()))
 		{
-			++aRemovedCnt;
-			std::copy(aResultIt->second.begin(), aResultIt->second.end(), std::back_inserter(aRemoved));
+			// The edits cancel out, the removal joins the previous equality
+			if(iEqualIt != anEnd)
+			{
+				iEqualIt->second.insert(iEqualIt->second.end(), aRemoved.begin(), aRemoved.end());
+				ioResult.erase(iRemoveIt);
+			}
+			else
+			{
+				iRemoveIt->first = operation::equal();
+				iEqualIt = iRemoveIt;
+			}
+			ioResult.erase(iInsertIt);
 		}
-		else if(aResultIt->first.isEqual())
+		else
 		{
-			// We encountered both insert and delete operations.
-			if((aInsertedCnt > 0) && (aRemovedCnt > 0))
+			if(aPfxSize > 0)
 			{
-				ioResult.erase(prior(aResultIt, aInsertedCnt + aRemovedCnt), aResultIt);
-				range_type aCommonPfx, aCommonSfx;
-				partition(aRemoved, aInserted, aCommonPfx, aCommonSfx);
-				if(!aCommonPfx.empty())
+				if(iEqualIt != anEnd)
 				{
-					if(aResultIt != ioResult.begin())
-					{
-						std::copy(aCommonPfx.begin(), aCommonPfx.end(), std::back_inserter(prior(aResultIt)->second));
-					}
-					else
-					{
-						ioResult.push_front(std::make_pair(operation::equal(), aCommonPfx));
-					}
+					iEqualIt->second.insert(iEqualIt->second.end(), aRemoved.begin(), detail::next(aRemoved.begin(), aPfxSize));
 				}
-				if(!aCommonSfx.empty())
+				else
 				{
-					std::copy(aResultIt->second.begin(), aResultIt->second.end(), std::back_inserter(aCommonSfx));
-					std::swap(aResultIt->second, aCommonSfx);
+					range_type aCommonPfx(ioResult.get_allocator());
+					aCommonPfx.assign(aRemoved.begin(), detail::next(aRemoved.begin(), aPfxSize));
+					iEqualIt = insert_swapped(ioResult, iRemoveIt, operation::equal(), aCommonPfx);
 				}
-				if(!aRemoved.empty())
+			}
+			if(aSfxSize > 0)
+			{
+				range_type aCommonSfx(ioResult.get_allocator());
+				aCommonSfx.assign(detail::prior(aRemoved.end(), aSfxSize), aRemoved.end());
+				if(iNextIt != anEnd)
 				{
-					ioResult.insert(aResultIt, std::make_pair(operation::remove(), aRemoved));
+					aCommonSfx.insert(aCommonSfx.end(), iNextIt->second.begin(), iNextIt->second.end());
+					iNextIt->second.swap(aCommonSfx);
 				}
-				if(!aInserted.empty())
+				else
 				{
-					ioResult.insert(aResultIt, std::make_pair(operation::insert(), aInserted));
+					iNextIt = insert_swapped(ioResult, anEnd, operation::equal(), aCommonSfx);
 				}
 			}
-			// Multiple consecutive inserts before equality, merge them together
-			else if(aInsertedCnt > 1)
-			{
-				ioResult.erase(prior(aResultIt, aInsertedCnt), aResultIt);
-				ioResult.insert(aResultIt, std::make_pair(operation::insert(), aInserted));
-			}
-			// Multiple consecutive removes before equality, merge them together
-			else if(aRemovedCnt > 1)
+
+			keep_middle(aRemoved, aPfxSize, aSfxSize, ioResult.get_allocator());
+			keep_middle(anInserted, aPfxSize, aSfxSize, ioResult.get_allocator());
+			if(aRemoved.empty())
 			{
-				ioResult.erase(prior(aResultIt, aRemovedCnt), aResultIt);
-				ioResult.insert(aResultIt, std::make_pair(operation::remove(), aRemoved));
+				ioResult.erase(iRemoveIt);
 			}
-			else if((aResultIt != ioResult.begin()) && prior(aResultIt)->first.isEqual())
+			if(anInserted.empty())
 			{
-				std::copy(aResultIt->second.begin(), aResultIt->second.end(), std::back_inserter(prior(aResultIt)->second));
-				aResultIt->second = prior(aResultIt)->second;
-				ioResult.erase(prior(aResultIt));
+				ioResult.erase(iInsertIt);
 			}
-			aInsertedCnt = 0;
-			aInserted.clear();
-			aRemovedCnt = 0;
-			aRemoved.clear();
 		}
-		++aResultIt;
 	}
-	if(ioResult.back().second.empty())
+
+	// Nothing left between the equalities, merge them together
+	if((iEqualIt != anEnd) && (iNextIt != anEnd) && (detail::next(iEqualIt) == iNextIt))
+	{
+		iEqualIt->second.insert(iEqualIt->second.end(), iNextIt->second.begin(), iNextIt->second.end());
+		ioResult.erase(iNextIt);
+		return iEqualIt;
+	}
+	return (iNextIt != anEnd) ? iNextIt : iEqualIt;
+}
+
+/*! Merges the hunks of the change block [iBegin, iEnd) into at most one
+ *  removal and one insertion and normalises them against the surrounding
+ *  equalities. Empty hunks are dropped.
+ *
+ * @param iEqualIt equality before the block or end
+ * @param iEnd equality after the block or end
+ * @return last equality up to the end of the block
+ */
+template<typename Result>
+typename Result::iterator cleanup_changes(Result& ioResult, typename Result::iterator iEqualIt,
+		typename Result::iterator iBegin, typename Result::iterator iEnd)
+{
+	typedef typename Result::iterator iterator;
+
+	const iterator anEnd = ioResult.end();
+	iterator aRemoveIt = anEnd;
+	iterator anInsertIt = anEnd;
+	while(iBegin != iEnd)
 	{
-		ioResult.pop_back();
+		if(iBegin->second.empty())
+		{
+			iBegin = ioResult.erase(iBegin);
+			continue;
+		}
+		iterator& aBlockIt = iBegin->first.isRemove() ? aRemoveIt : anInsertIt;
+		if(aBlockIt == anEnd)
+		{
+			aBlockIt = iBegin;
+			++iBegin;
+		}
+		else
+		{
+			// Multiple removals or insertions in the block, merge them together
+			aBlockIt->second.insert(aBlockIt->second.end(), iBegin->second.begin(), iBegin->second.end());
+			iBegin = ioResult.erase(iBegin);
+		}
 	}
+	return cleanup_block(ioResult, iEqualIt, aRemoveIt, anInsertIt, iEnd);
 }
 
+/*! First pass: merge consecutive hunks of the same kind, put removals before
+ *  insertions and factor out their common prefix and suffix.
+ *
+ * Single pass over the hunks, nodes are merged in place and ranges are
+ * only appended to or truncated at their end, see cleanup_block(). Hunks
+ * before the last equality are final and added to oStats as it goes.
+ */
 template<typename Result>
-void cleanup_second_pass(Result& ioResult)
+void cleanup_first_pass(Result& ioResult, stats& oStats)
+{
+	typedef typename Result::iterator iterator;
+
+	oStats = stats();
+	const iterator anEnd = ioResult.end();
+	iterator anEqualIt = anEnd;
+	iterator aBlockIt = ioResult.begin();
+	iterator aResultIt = aBlockIt;
+	while(aResultIt != anEnd)
+	{
+		if(aResultIt->first.isEqual() && !aResultIt->second.empty())
+		{
+			const iterator aNewEqualIt = cleanup_changes(ioResult, anEqualIt, aBlockIt, aResultIt);
+			add_hunks(oStats, (anEqualIt != anEnd) ? anEqualIt : ioResult.begin(), aNewEqualIt);
+			anEqualIt = aNewEqualIt;
+			aBlockIt = detail::next(anEqualIt);
+			aResultIt = aBlockIt;
+		}
+		else
+		{
+			++aResultIt;
+		}
+	}
+	cleanup_changes(ioResult, anEqualIt, aBlockIt, anEnd);
+	add_hunks(oStats, (anEqualIt != anEnd) ? anEqualIt : ioResult.begin(), anEnd);
+}
+
+template<typename Result>
+void cleanup_first_pass(Result& ioResult)
+{
+	stats aStats;
+	cleanup_first_pass(ioResult, aStats);
+}
+
+/*! Normalises the change block containing the hunk after one of its
+ *  neighbouring equalities was eliminated.
+ *
+ * Hunks outside the block are already normalised, so the block is at most
+ * a few hunks long.
+ *
+ * @return equality before the block, or the first hunk if there is none
+ */
+template<typename Result>
+typename Result::iterator cleanup_neighbourhood(Result& ioResult, typename Result::iterator iChangeIt)
+{
+	typedef typename Result::iterator iterator;
+
+	const iterator anEnd = ioResult.end();
+	iterator aBegin = iChangeIt;
+	while((aBegin != ioResult.begin()) && !detail::prior(aBegin)->first.isEqual())
+	{
+		--aBegin;
+	}
+	iterator aBlockEnd = detail::next(iChangeIt);
+	while((aBlockEnd != anEnd) && !aBlockEnd->first.isEqual())
+	{
+		++aBlockEnd;
+	}
+	const iterator anEqualIt = (aBegin != ioResult.begin()) ? detail::prior(aBegin) : anEnd;
+	cleanup_changes(ioResult, anEqualIt, aBegin, aBlockEnd);
+	return (anEqualIt != anEnd) ? anEqualIt : ioResult.begin();
+}
+
+/*! Shifts the edit right across the following equalities as long as it
+ *  starts with them, absorbing following edits of the same kind.
+ *
+ * The shifted prefix of the edit is erased once when the cascade stops, so
+ * repeated shifts of a growing edit stay linear in its size. The statistics
+ * of the hunks from the equality before the edit up to the one after the
+ * normalised block are replaced in ioStats.
+ *
+ * @return equality before the edit, where scanning resumes
+ */
+template<typename Result>
+typename Result::iterator shift_right(Result& ioResult, typename Result::iterator iPrevIt,
+		typename Result::iterator iEditIt, stats& ioStats)
 {
 	typedef typename Result::value_type::second_type range_type;
+	typedef typename Result::iterator iterator;
 
-	/* Second pass: look for single edits surrounded on both sides by equalities
-	 * which can be shifted sideways to eliminate an equality.
-	 * e.g: A<ins>BA</ins>C -> <ins>AB</ins>AC (ABAC)
-	 * e.g: AX<ins>BAX</ins>C -> <ins>AXB</ins>AXC (AXBAXC)
-	 * e.g: GH<del>KOP</del>KO -> GHKO<del>PKO</del> (GHKO)
-	 */
-	const size_t aResultSize = ioResult.size();
-	if(aResultSize < 3)
+	range_type& aPrev = iPrevIt->second;
+	range_type& anEdit = iEditIt->second;
+	stats aBefore;
+	aBefore.add(iPrevIt->first, aPrev.size());
+	aBefore.add(iEditIt->first, anEdit.size());
+	size_t aShift(0);
+	iterator aNextIt = detail::next(iEditIt);
+	do
 	{
-		return;
+		aBefore.add(aNextIt->first, aNextIt->second.size());
+		aPrev.insert(aPrev.end(), aNextIt->second.begin(), aNextIt->second.end());
+		anEdit.insert(anEdit.end(), aNextIt->second.begin(), aNextIt->second.end());
+		aShift += aNextIt->second.size();
+		aNextIt = ioResult.erase(aNextIt);
+		if((aNextIt != ioResult.end()) && (aNextIt->first == iEditIt->first))
+		{
+			aBefore.add(aNextIt->first, aNextIt->second.size());
+			anEdit.insert(anEdit.end(), aNextIt->second.begin(), aNextIt->second.end());
+			aNextIt = ioResult.erase(aNextIt);
+		}
 	}
-	typename Result::iterator aPrevIt = ioResult.begin();
-	typename Result::iterator aResultIt = next(aPrevIt);
-	typename Result::iterator aNextIt = next(aResultIt);
-	while(aNextIt != ioResult.end())
+	while((aNextIt != ioResult.end()) && aNextIt->first.isEqual() &&
+			((anEdit.size() - aShift < aPrev.size()) ||
+					!ends_with(detail::next(anEdit.begin(), aShift), anEdit.end(), aPrev.begin(), aPrev.end())) &&
+			starts_with(detail::next(anEdit.begin(), aShift), anEdit.end(), aNextIt->second.begin(), aNextIt->second.end()));
+
+	anEdit.erase(anEdit.begin(), detail::next(anEdit.begin(), aShift));
+
+	// Hunks up to the equality closing the block are rewritten
+	iterator aRegionEnd = aNextIt;
+	while((aRegionEnd != ioResult.end()) && !aRegionEnd->first.isEqual())
 	{
-		if(aPrevIt->first.isEqual() && aNextIt->first.isEqual())
+		++aRegionEnd;
+	}
+	if(aRegionEnd != ioResult.end())
+	{
+		++aRegionEnd;
+	}
+	add_hunks(aBefore, aNextIt, aRegionEnd);
+
+	const iterator aResultIt = cleanup_neighbourhood(ioResult, iEditIt);
+	ioStats -= aBefore;
+	ioStats += hunk_stats(aResultIt, aRegionEnd);
+	return aResultIt;
+}
+
+/*! Second pass: look for single edits surrounded on both sides by equalities
+ *  which can be shifted sideways to eliminate an equality.
+ *
+ * e.g: A<ins>BA</ins>C -> <ins>AB</ins>AC (ABAC)
+ * e.g: AX<ins>BAX</ins>C -> <ins>AXB</ins>AXC (AXBAXC)
+ * e.g: GH<del>KOP</del>KO -> GHKO<del>PKO</del> (GHKO)
+ *
+ * Expects the output of the first pass. After a shift only the block around
+ * the shifted edit is normalised again and scanning resumes at the equality
+ * before it. Every shift eliminates an equality, so the hunks are revisited
+ * a bounded number of times and the pass is linear in the number of hunks.
+ * The statistics in ioStats are updated for the rewritten hunks only.
+ */
+template<typename Result>
+void cleanup_second_pass(Result& ioResult, stats& ioStats)
+{
+	typedef typename Result::iterator iterator;
+
+	iterator aResultIt = ioResult.begin();
+	while(aResultIt != ioResult.end())
+	{
+		const iterator aNextIt = detail::next(aResultIt);
+		if(aResultIt->first.isEqual() || (aResultIt == ioResult.begin()) || (aNextIt == ioResult.end()) ||
+				!aNextIt->first.isEqual() || !detail::prior(aResultIt)->first.isEqual())
 		{
-			if(ends_with(aResultIt->second.begin(), aResultIt->second.end(), aPrevIt->second.begin(), aPrevIt->second.end()))
+			++aResultIt;
+			continue;
+		}
+
+		const iterator aPrevIt = detail::prior(aResultIt);
+		if(ends_with(aResultIt->second.begin(), aResultIt->second.end(), aPrevIt->second.begin(), aPrevIt->second.end()))
+		{
+			// Hunks from the equality before the block up to the next one
+			// are rewritten
+			iterator aRegionIt = aPrevIt;
+			while((aRegionIt != ioResult.begin()) && !detail::prior(aRegionIt)->first.isEqual())
 			{
-				const size_t aSize = aResultIt->second.size();
-				range_type aTmp(aPrevIt->second);
-				aTmp.insert(aTmp.end(), aResultIt->second.begin(), aResultIt->second.end());
-				aResultIt->second = aTmp;
-				aResultIt->second.resize(aSize);
-				aPrevIt->second.insert(aPrevIt->second.end(), aNextIt->second.begin(), aNextIt->second.end());
-				aNextIt->second = aPrevIt->second;
-				ioResult.erase(aPrevIt);
+				--aRegionIt;
 			}
-			else if(starts_with(aResultIt->second.begin(), aResultIt->second.end(), aNextIt->second.begin(), aNextIt->second.end()))
+			if(aRegionIt != ioResult.begin())
 			{
-				aPrevIt->second.insert(aPrevIt->second.end(), aNextIt->second.begin(), aNextIt->second.end());
-				aResultIt->second.erase(aResultIt->second.begin(), next(aResultIt->second.begin(), aNextIt->second.size()));
-				aResultIt->second.insert(aResultIt->second.end(), aNextIt->second.begin(), aNextIt->second.end());
-				ioResult.erase(aNextIt);
+				--aRegionIt;
 			}
+			const iterator aRegionEnd = detail::next(aNextIt);
+			ioStats -= hunk_stats(aRegionIt, aRegionEnd);
+
+			const size_t aSize = aResultIt->second.size();
+			aResultIt->second.insert(aResultIt->second.begin(), aPrevIt->second.begin(), aPrevIt->second.end());
+			aResultIt->second.resize(aSize);
+			aPrevIt->second.insert(aPrevIt->second.end(), aNextIt->second.begin(), aNextIt->second.end());
+			aNextIt->second.swap(aPrevIt->second);
+			ioResult.erase(aPrevIt);
+			aResultIt = cleanup_neighbourhood(ioResult, aResultIt);
+			ioStats += hunk_stats(aResultIt, aRegionEnd);
+		}
+		else if(starts_with(aResultIt->second.begin(), aResultIt->second.end(), aNextIt->second.begin(), aNextIt->second.end()))
+		{
+			aResultIt = shift_right(ioResult, aPrevIt, aResultIt, ioStats);
+		}
+		else
+		{
+			++aResultIt;
 		}
-		aPrevIt = aResultIt;
-		++aResultIt;
-		aNextIt = (aResultIt != ioResult.end()) ? next(aResultIt) : aResultIt;
-	}
-	if(aResultSize != ioResult.size())
-	{
-		cleanup(ioResult);
 	}
 }
 
+/*! Normalises the hunks, linear in their number (no recursion, no repeated
+ *  full passes).
+ *
+ * @param oStats statistics of the normalised hunks
+ */
+template<typename Result>
+void cleanup(Result& ioResult, stats& oStats)
+{
+	cleanup_first_pass(ioResult, oStats);
+	cleanup_second_pass(ioResult, oStats);
+}
+
 template<typename Result>
 void cleanup(Result& ioResult)
 {
-	cleanup_first_pass(ioResult);
-	cleanup_second_pass(ioResult);
+	stats aStats;
+	cleanup(ioResult, aStats);
 }
 
 }  // namespace detail
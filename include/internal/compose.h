@@ -0,0 +1,162 @@
+#ifndef IZI_DIFF_COMPOSE_H_
+#define IZI_DIFF_COMPOSE_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <utility>
+
+#include "algorithm.h"
+#include "operation.h"
+
+namespace izi {
+namespace diff {
+namespace detail {
+
+//! Cursor over the elements of a hunk sequence.
+template<typename Iterator>
+class hunk_cursor
+{
+public:
+	typedef typename std::iterator_traits<Iterator>::value_type::second_type::const_iterator element_iterator;
+
+	hunk_cursor(Iterator iBegin, Iterator iEnd): _hunkIt(iBegin), _end(iEnd), _offset(0)
+	{
+		skip_empty();
+	}
+
+	bool done() const
+	{
+		return _hunkIt == _end;
+	}
+
+	operation op() const
+	{
+		return _hunkIt->first;
+	}
+
+	size_t left() const
+	{
+		return _hunkIt->second.size() - _offset;
+	}
+
+	element_iterator position() const
+	{
+		return detail::next(_hunkIt->second.begin(), _offset);
+	}
+
+	void advance(size_t iSize)
+	{
+		_offset += iSize;
+		skip_empty();
+	}
+
+private:
+	void skip_empty()
+	{
+		while((_hunkIt != _end) && (_offset == _hunkIt->second.size()))
+		{
+			++_hunkIt;
+			_offset = 0;
+		}
+	}
+
+	Iterator _hunkIt;
+	Iterator _end;
+	size_t _offset;
+};
+
+/*! Appends the diff of A and C composed of the diffs of A and B (first
+ *  hunks) and of B and C (second hunks).
+ *
+ * Single pass over both hunk sequences, the elements of B are walked in
+ * step: elements equal in both diffs stay equal, equal ones removed by the
+ * second diff are removed, inserted ones kept by it are inserted and
+ * inserted ones removed by it cancel out. Removals of the first diff and
+ * insertions of the second one pass through. Hunks are appended as views
+ * of the hunks they come from and are not normalised.
+ *
+ * Both diffs must have the same B: the elements of the first diff's
+ * equalities and insertions, and of the second diff's equalities and removals.
+ *
+ * @return false if the lengths of their Bs differ, the hunks appended are
+ *         incomplete then
+ */
+template<typename Iterator1, typename Iterator2, typename Result>
+bool compose(Iterator1 iBegin1, Iterator1 iEnd1, Iterator2 iBegin2, Iterator2 iEnd2, Result& oResult)
+{
+	typedef typename Result::value_type::second_type range_type;
+
+	hunk_cursor<Iterator1> aFirst(iBegin1, iEnd1);
+	hunk_cursor<Iterator2> aSecond(iBegin2, iEnd2);
+	while(!aFirst.done() || !aSecond.done())
+	{
+		if(!aFirst.done() && aFirst.op().isRemove())
+		{
+			const size_t aSize = aFirst.left();
+			oResult.push_back(std::make_pair(operation::remove(),
+					range_type(aFirst.position(), detail::next(aFirst.position(), aSize))));
+			aFirst.advance(aSize);
+			continue;
+		}
+		if(!aSecond.done() && aSecond.op().isInsert())
+		{
+			const size_t aSize = aSecond.left();
+			oResult.push_back(std::make_pair(operation::insert(),
+					range_type(aSecond.position(), detail::next(aSecond.position(), aSize))));
+			aSecond.advance(aSize);
+			continue;
+		}
+		if(aFirst.done() || aSecond.done())
+		{
+			// Diffs of different Bs
+			return false;
+		}
+
+		const size_t aSize = std::min(aFirst.left(), aSecond.left());
+		if(!aFirst.op().isInsert() || !aSecond.op().isRemove())
+		{
+			const operation anOperation(aFirst.op().isInsert() ? operation::insert() :
+					(aSecond.op().isRemove() ? operation::remove() : operation::equal()));
+			oResult.push_back(std::make_pair(anOperation,
+					range_type(aFirst.position(), detail::next(aFirst.position(), aSize))));
+		}
+		aFirst.advance(aSize);
+		aSecond.advance(aSize);
+	}
+	return true;
+}
+
+/*! Turns the diff of A and B into the diff of B and A in place.
+ *
+ * Removals become insertions and vice versa. A removal followed by an
+ * insertion swaps their contents instead, so normalised hunks stay
+ * normalised.
+ */
+template<typename Result>
+void invert(Result& ioResult)
+{
+	for(typename Result::iterator aHunkIt = ioResult.begin(); aHunkIt != ioResult.end(); ++aHunkIt)
+	{
+		if(aHunkIt->first.isEqual())
+		{
+			continue;
+		}
+		const typename Result::iterator aNextIt = detail::next(aHunkIt);
+		if(aHunkIt->first.isRemove() && (aNextIt != ioResult.end()) && aNextIt->first.isInsert())
+		{
+			std::swap(aHunkIt->second, aNextIt->second);
+			aHunkIt = aNextIt;
+		}
+		else
+		{
+			aHunkIt->first = aHunkIt->first.isRemove() ? operation::insert() : operation::remove();
+		}
+	}
+}
+
+}  // namespace detail
+}  // namespace diff
+}  // namespace izi
+
+#endif /* IZI_DIFF_COMPOSE_H_ */
@@ -0,0 +1,191 @@
+#ifndef IZI_DIFF_DELTA_H_
+#define IZI_DIFF_DELTA_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+
+#include "calculation.h"
+#include "range_traits.h"
+#include "serialization.h"
+#include "types.h"
+#include "visitor_sink.h"
+
+namespace izi {
+namespace diff {
+
+/* Binary delta format
+ *
+ * The delta starts with the sizes of the source and of the target as
+ * varints, followed by instructions building the target in order. Each one
+ * is an opcode byte: COPY (detail::DELTA_COPY) followed by the offset in the
+ * source and the length as varints, or ADD (detail::DELTA_ADD) followed by
+ * the length as a varint and the added bytes. Removed bytes are implied by
+ * the offsets of the copies.
+ */
+
+namespace detail {
+
+enum DELTA_OPCODE
+{
+	DELTA_COPY = 0,
+	DELTA_ADD = 1
+};
+
+//! Default largest target apply_delta() allocates, 1 GiB.
+const size_t kDefaultMaxTargetSize = size_t(1) << 30;
+
+}  // namespace detail
+
+/*! Visitor writing streamed hunks of byte ranges as delta instructions,
+ *  usable with compute().
+ *
+ * Equalities become copies from the source, insertions additions, removals
+ * write nothing. The header is written by encode_delta().
+ *
+ * @param Iterator iterator over the source the equalities view
+ */
+template<typename Iterator, typename OutputIterator>
+class delta_encoder
+{
+public:
+	delta_encoder(Iterator iSource, OutputIterator iOutput): _source(iSource), _output(iOutput) {}
+
+	void on_equal(Iterator iBegin, Iterator iEnd)
+	{
+		*_output = static_cast<char>(detail::DELTA_COPY);
+		++_output;
+		_output = detail::write_varint(std::distance(_source, iBegin), _output);
+		_output = detail::write_varint(std::distance(iBegin, iEnd), _output);
+	}
+
+	void on_remove(Iterator, Iterator)
+	{
+	}
+
+	template<typename InsertIterator>
+	void on_insert(InsertIterator iBegin, InsertIterator iEnd)
+	{
+		*_output = static_cast<char>(detail::DELTA_ADD);
+		++_output;
+		_output = detail::write_varint(std::distance(iBegin, iEnd), _output);
+		for(; iBegin != iEnd; ++iBegin)
+		{
+			*_output = static_cast<char>(*iBegin);
+			++_output;
+		}
+	}
+
+	OutputIterator output() const
+	{
+		return _output;
+	}
+
+private:
+	Iterator _source;
+	OutputIterator _output;
+};
+
+/*! Diffs two byte ranges and writes the target as a delta of the source.
+ *
+ * Ranges are diffed element by element whatever their traits, e.g.
+ * std::vector<unsigned char>, std::string or range<const unsigned char*>.
+ *
+ * @param oOutput output iterator accepting chars
+ * @return output iterator past the last written byte
+ */
+template<typename Range, typename OutputIterator>
+OutputIterator encode_delta(const Range& iSource, const Range& iTarget, OutputIterator oOutput,
+		const options& iOptions = options())
+{
+	typedef typename Range::const_iterator iterator;
+	typedef char single_byte_element_required[sizeof(typename Range::value_type) == 1 ? 1 : -1];
+	(void)sizeof(single_byte_element_required);
+
+	oOutput = detail::write_varint(iSource.size(), oOutput);
+	oOutput = detail::write_varint(iTarget.size(), oOutput);
+
+	delta_encoder<iterator, OutputIterator> anEncoder(iSource.begin(), oOutput);
+	detail::visitor_sink<delta_encoder<iterator, OutputIterator>, iterator> aSink(anEncoder,
+			iSource.begin(), iTarget.begin());
+	detail::calculate_hunks<detail::void_traits>(iSource.begin(), iSource.end(), iTarget.begin(), iTarget.end(),
+			aSink, iOptions);
+	aSink.flush();
+	return anEncoder.output();
+}
+
+/*! Rebuilds the target from the source and a delta in a single pass.
+ *
+ * The target is sized once from the header, then filled by the
+ * instructions as they are read, so the delta may come from an input
+ * stream. Copies out of the source and instructions not filling the target
+ * exactly are rejected, the content of the target is unspecified then.
+ * Headers announcing a target larger than iMaxTargetSize are rejected
+ * before anything is allocated.
+ *
+ * @param iBegin begin of the delta (input iterator over bytes)
+ * @param oTarget resized to the target size, e.g. std::vector<unsigned char>
+ * @param iMaxTargetSize largest target size accepted
+ * @return false if the delta is malformed, does not match the source or
+ *         its target is too large
+ */
+template<typename Range, typename InputIterator>
+bool apply_delta(const Range& iSource, InputIterator iBegin, InputIterator iEnd, Range& oTarget,
+		size_t iMaxTargetSize = detail::kDefaultMaxTargetSize)
+{
+	typedef typename Range::value_type element_type;
+
+	size_t aSourceSize;
+	size_t aTargetSize;
+	if(!detail::read_varint(iBegin, iEnd, aSourceSize) || !detail::read_varint(iBegin, iEnd, aTargetSize) ||
+			(aSourceSize != iSource.size()) || (aTargetSize > iMaxTargetSize) || (aTargetSize > oTarget.max_size()))
+	{
+		return false;
+	}
+	oTarget.resize(aTargetSize);
+
+	typename Range::iterator anOutputIt = oTarget.begin();
+	size_t aLeft(aTargetSize);
+	while(iBegin != iEnd)
+	{
+		const unsigned char anOpcode = static_cast<unsigned char>(*iBegin);
+		++iBegin;
+		size_t anOffset(0);
+		size_t aLength;
+		if(((anOpcode == detail::DELTA_COPY) && !detail::read_varint(iBegin, iEnd, anOffset)) ||
+				!detail::read_varint(iBegin, iEnd, aLength) || (aLength > aLeft))
+		{
+			return false;
+		}
+		if(anOpcode == detail::DELTA_COPY)
+		{
+			if((anOffset > aSourceSize) || (aLength > aSourceSize - anOffset))
+			{
+				return false;
+			}
+			anOutputIt = std::copy(iSource.begin() + anOffset, iSource.begin() + anOffset + aLength, anOutputIt);
+		}
+		else if(anOpcode == detail::DELTA_ADD)
+		{
+			for(size_t anIndex = 0; anIndex < aLength; ++anIndex, ++iBegin, ++anOutputIt)
+			{
+				if(iBegin == iEnd)
+				{
+					return false;
+				}
+				*anOutputIt = static_cast<element_type>(*iBegin);
+			}
+		}
+		else
+		{
+			return false;
+		}
+		aLeft -= aLength;
+	}
+	return aLeft == 0;
+}
+
+}  // namespace diff
+}  // namespace izi
+
+#endif /* IZI_DIFF_DELTA_H_ */
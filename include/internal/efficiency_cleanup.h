@@ -0,0 +1,114 @@
+#ifndef IZI_DIFF_EFFICIENCY_CLEANUP_H_
+#define IZI_DIFF_EFFICIENCY_CLEANUP_H_
+
+#include <vector>
+
+#include "cleanup.h"
+
+namespace izi {
+namespace diff {
+namespace detail {
+
+//! Default cost of an edit in elements, as in diff-match-patch.
+const size_t kDefaultEditCost = 4;
+
+/*! Checks if keeping the equality costs more than turning it into edits.
+ *
+ * Equalities shorter than the edit cost are merged into the surrounding
+ * edits when there are insertions and removals on both sides of it, or on
+ * three sides and the equality is shorter than half the edit cost.
+ * e.g: <del>A</del><ins>B</ins>XY<del>C</del><ins>D</ins>
+ * e.g: <ins>A</ins>X<del>C</del><ins>D</ins>
+ */
+template<typename Entry>
+bool is_costly(const Entry& iEqual, size_t iInsertSize, size_t iRemoveSize, size_t iEditCost)
+{
+	const int aSides = (iEqual._insertSize > 0) + (iEqual._removeSize > 0) + (iInsertSize > 0) + (iRemoveSize > 0);
+	return (aSides == 4) || ((aSides == 3) && (2 * iEqual._it->second.size() < iEditCost));
+}
+
+/*! Eliminates short equalities whose edit cost outweighs keeping them.
+ *
+ * Produces fewer hunks for diffs consumed by machines, at the price of
+ * larger edits. Equalities which can still be eliminated are kept on
+ * a stack with the sizes of the edits before them. An elimination only
+ * affects the previous candidate, so it is checked again without
+ * rescanning. The result is normalised once at the end.
+ *
+ * @param iEditCost cost of an edit in elements
+ * @param ioStats statistics of the hunks, updated if any equality is
+ *        eliminated
+ */
+template<typename Result>
+void cleanup_efficiency(Result& ioResult, size_t iEditCost, stats& ioStats)
+{
+	typedef typename Result::iterator iterator;
+	typedef equality_entry<iterator> entry_type;
+	typedef typename rebind_allocator<typename Result::allocator_type, entry_type>::type entry_allocator;
+
+	std::vector<entry_type, entry_allocator> anEqualities((entry_allocator(ioResult.get_allocator())));
+	bool aChanged(false);
+
+	// Sizes of the edits after the last equality
+	size_t anInsertSize(0);
+	size_t aRemoveSize(0);
+
+	const iterator aResultEnd = ioResult.end();
+	for(iterator aResultIt = ioResult.begin(); aResultIt != aResultEnd; ++aResultIt)
+	{
+		if(aResultIt->first.isEqual())
+		{
+			if((aResultIt->second.size() < iEditCost) && (anInsertSize + aRemoveSize > 0))
+			{
+				anEqualities.push_back(entry_type(aResultIt, anInsertSize, aRemoveSize));
+			}
+			else
+			{
+				// Never eliminated, neither are the equalities before it
+				anEqualities.clear();
+			}
+			anInsertSize = 0;
+			aRemoveSize = 0;
+			continue;
+		}
+
+		(aResultIt->first.isInsert() ? anInsertSize : aRemoveSize) += aResultIt->second.size();
+		while(!anEqualities.empty() && is_costly(anEqualities.back(), anInsertSize, aRemoveSize, iEditCost))
+		{
+			const entry_type anEqual = anEqualities.back();
+			const size_t anEqualSize = anEqual._it->second.size();
+
+			// Replace the equality by its removal and insertion
+			ioResult.insert(detail::next(anEqual._it), std::make_pair(operation::insert(), anEqual._it->second));
+			anEqual._it->first = operation::remove();
+			anInsertSize += anEqual._insertSize + anEqualSize;
+			aRemoveSize += anEqual._removeSize + anEqualSize;
+			anEqualities.pop_back();
+			aChanged = true;
+
+			if((anEqual._insertSize > 0) && (anEqual._removeSize > 0))
+			{
+				// No change which could affect the previous candidates
+				anEqualities.clear();
+			}
+		}
+	}
+
+	if(aChanged)
+	{
+		cleanup(ioResult, ioStats);
+	}
+}
+
+template<typename Result>
+void cleanup_efficiency(Result& ioResult, size_t iEditCost = kDefaultEditCost)
+{
+	stats aStats;
+	cleanup_efficiency(ioResult, iEditCost, aStats);
+}
+
+}  // namespace detail
+}  // namespace diff
+}  // namespace izi
+
+#endif /* IZI_DIFF_EFFICIENCY_CLEANUP_H_ */
@@ -0,0 +1,77 @@
+#ifndef IZI_DIFF_EXECUTOR_H_
+#define IZI_DIFF_EXECUTOR_H_
+
+#include <algorithm>
+#include <cstddef>
+
+#if __cplusplus >= 201103L
+#include <atomic>
+#include <thread>
+#include <vector>
+#endif
+
+namespace izi {
+namespace diff {
+
+/*! Runs the tasks one after another in the calling thread.
+ *
+ * Executors provide for_each(begin, end, function) which calls the function
+ * on every element of the range and returns once all calls are done. Calls
+ * may run concurrently but never on the same element, so any thread pool can
+ * be plugged in through a class with the same member.
+ */
+struct sequential_executor
+{
+	template<typename Iterator, typename Function>
+	void for_each(Iterator iBegin, Iterator iEnd, Function iFunction) const
+	{
+		std::for_each(iBegin, iEnd, iFunction);
+	}
+};
+
+#if __cplusplus >= 201103L
+/*! Runs the tasks on a fixed number of threads, the calling one included.
+ *
+ * Threads are started for each for_each() call and take the elements of the
+ * random access range in order until none are left.
+ */
+class thread_executor
+{
+public:
+	explicit thread_executor(unsigned iThreads = std::thread::hardware_concurrency()):
+		_threads(iThreads > 0 ? iThreads : 1) {}
+
+	template<typename Iterator, typename Function>
+	void for_each(Iterator iBegin, Iterator iEnd, Function iFunction) const
+	{
+		const size_t aSize = iEnd - iBegin;
+		std::atomic<size_t> aNext(0);
+		auto aWorker = [&]()
+		{
+			for(size_t anIndex = aNext++; anIndex < aSize; anIndex = aNext++)
+			{
+				iFunction(iBegin[anIndex]);
+			}
+		};
+
+		std::vector<std::thread> aThreads;
+		for(size_t anIndex = 1; anIndex < std::min<size_t>(_threads, aSize); ++anIndex)
+		{
+			aThreads.emplace_back(aWorker);
+		}
+		aWorker();
+		for(std::thread& aThread : aThreads)
+		{
+			aThread.join();
+		}
+	}
+
+private:
+	unsigned _threads;
+};
+#endif
+
+}  // namespace diff
+}  // namespace izi
+
+#endif /* IZI_DIFF_EXECUTOR_H_ */
@@ -0,0 +1,240 @@
+#ifndef IZI_DIFF_FILE_DIFF_H_
+#define IZI_DIFF_FILE_DIFF_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define IZI_DIFF_POSIX_FILES 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
+
+#include "flat_result.h"
+#include "range_traits.h"
+#include "types.h"
+
+namespace izi {
+namespace diff {
+namespace detail {
+
+//! Chunk size of streamed reads.
+const size_t kFileReadSize = 65536;
+
+//! Contents of files are diffed by lines, as strings.
+template<>
+struct range_traits<range<const char*> >: range_traits<std::string>
+{
+};
+
+}  // namespace detail
+
+/*! Read only contents of a file.
+ *
+ * Regular files are mapped into memory where mmap is available, other ones
+ * (pipes, character devices, files of unknown size) and platforms without
+ * it are read into a buffer.
+ */
+class mapped_file
+{
+public:
+	mapped_file(): _data(0), _size(0), _mapped(false) {}
+
+	~mapped_file()
+	{
+		close();
+	}
+
+	//! Replaces the contents with the file's, false if it cannot be read.
+	bool open(const std::string& iPath)
+	{
+		close();
+#ifdef IZI_DIFF_POSIX_FILES
+		const int aFile = ::open(iPath.c_str(), O_RDONLY);
+		if(aFile < 0)
+		{
+			return false;
+		}
+		struct stat aStat;
+		bool aRead(false);
+		if((::fstat(aFile, &aStat) == 0) && S_ISREG(aStat.st_mode) && (aStat.st_size > 0))
+		{
+			void* aData = ::mmap(0, static_cast<size_t>(aStat.st_size), PROT_READ, MAP_PRIVATE, aFile, 0);
+			if(aData != MAP_FAILED)
+			{
+				_data = static_cast<const char*>(aData);
+				_size = static_cast<size_t>(aStat.st_size);
+				_mapped = true;
+				aRead = true;
+			}
+		}
+		if(!aRead)
+		{
+			aRead = read(aFile);
+		}
+		::close(aFile);
+		return aRead;
+#else
+		std::ifstream aFile(iPath.c_str(), std::ios::in | std::ios::binary);
+		if(!aFile)
+		{
+			return false;
+		}
+		while(aFile)
+		{
+			const size_t aSize = _buffer.size();
+			_buffer.resize(aSize + detail::kFileReadSize);
+			aFile.read(&_buffer[aSize], detail::kFileReadSize);
+			_buffer.resize(aSize + static_cast<size_t>(aFile.gcount()));
+		}
+		if(aFile.bad())
+		{
+			_buffer.clear();
+			return false;
+		}
+		bind_buffer();
+		return true;
+#endif
+	}
+
+	void close()
+	{
+#ifdef IZI_DIFF_POSIX_FILES
+		if(_mapped)
+		{
+			::munmap(const_cast<char*>(_data), _size);
+		}
+#endif
+		std::vector<char>().swap(_buffer);
+		_data = 0;
+		_size = 0;
+		_mapped = false;
+	}
+
+	const char* begin() const
+	{
+		return _data;
+	}
+
+	const char* end() const
+	{
+		return _data + _size;
+	}
+
+	size_t size() const
+	{
+		return _size;
+	}
+
+	//! Whether the contents are mapped rather than read.
+	bool mapped() const
+	{
+		return _mapped;
+	}
+
+private:
+	mapped_file(const mapped_file&);
+	mapped_file& operator=(const mapped_file&);
+
+#ifdef IZI_DIFF_POSIX_FILES
+	bool read(int iFile)
+	{
+		for(;;)
+		{
+			const size_t aSize = _buffer.size();
+			_buffer.resize(aSize + detail::kFileReadSize);
+			const ssize_t aRead = ::read(iFile, &_buffer[aSize], detail::kFileReadSize);
+			_buffer.resize(aSize + (aRead > 0 ? static_cast<size_t>(aRead) : 0));
+			if(aRead == 0)
+			{
+				break;
+			}
+			if(aRead < 0)
+			{
+				_buffer.clear();
+				return false;
+			}
+		}
+		bind_buffer();
+		return true;
+	}
+#endif
+
+	void bind_buffer()
+	{
+		_data = _buffer.empty() ? 0 : &_buffer[0];
+		_size = _buffer.size();
+	}
+
+	const char* _data;
+	size_t _size;
+	bool _mapped;
+	std::vector<char> _buffer;
+};
+
+/*! Diff of two files, the edit script references their mapped contents.
+ *
+ * Filled by diff_files(), the files stay open as long as the diff.
+ */
+class file_diff
+{
+public:
+	typedef range<const char*> view_type;
+	typedef flat_result<view_type> script_type;
+
+	const script_type& script() const
+	{
+		return _script;
+	}
+
+	const mapped_file& file1() const
+	{
+		return _file1;
+	}
+
+	const mapped_file& file2() const
+	{
+		return _file2;
+	}
+
+private:
+	friend bool diff_files(const std::string&, const std::string&, file_diff&, const options&);
+
+	mapped_file _file1;
+	mapped_file _file2;
+	script_type _script;
+};
+
+/*! Diffs two files by lines without copying their contents.
+ *
+ * Regular files are mapped read only and diffed in place as ranges of
+ * const char, other ones are read first, see mapped_file.
+ *
+ * @param oDiff receives both files and the edit script viewing them
+ * @return false if a file cannot be read, oDiff is empty then
+ */
+inline bool diff_files(const std::string& iPath1, const std::string& iPath2, file_diff& oDiff,
+		const options& iOptions = options())
+{
+	oDiff._script = file_diff::script_type();
+	if(!oDiff._file1.open(iPath1) || !oDiff._file2.open(iPath2))
+	{
+		oDiff._file1.close();
+		oDiff._file2.close();
+		return false;
+	}
+	oDiff._script = file_diff::script_type(file_diff::view_type(oDiff._file1.begin(), oDiff._file1.end()),
+			file_diff::view_type(oDiff._file2.begin(), oDiff._file2.end()));
+	oDiff._script.calculate(iOptions);
+	return true;
+}
+
+}  // namespace diff
+}  // namespace izi
+
+#endif /* IZI_DIFF_FILE_DIFF_H_ */
@@ -0,0 +1,573 @@
+#ifndef IZI_DIFF_FLAT_RESULT_H_
+#define IZI_DIFF_FLAT_RESULT_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <list>
+#include <utility>
+#include <vector>
+
+#include "calculation.h"
+#include "compose.h"
+#include "operation.h"
+#include "patch.h"
+#include "range_traits.h"
+#include "stats.h"
+#include "types.h"
+#include "visitor_sink.h"
+
+namespace izi {
+namespace diff {
+
+/*! Single record of the flat edit script.
+ *
+ * Positions are offsets of the hunk start in the first and the second range,
+ * so equalities and removals are read from the first range and insertions
+ * from the second one.
+ */
+struct hunk
+{
+	hunk(operation iOperation, size_t iPos1, size_t iPos2, size_t iLength):
+		_operation(iOperation), _pos1(iPos1), _pos2(iPos2), _length(iLength) {}
+
+	operation _operation;
+	size_t _pos1;
+	size_t _pos2;
+	size_t _length;
+};
+
+namespace detail {
+
+/*! Random access iterator over hunk records yielding lazy views
+ *  into the diffed ranges.
+ */
+template<typename Iterator>
+class flat_iterator
+{
+public:
+	typedef std::random_access_iterator_tag iterator_category;
+	typedef std::pair<operation, range<Iterator> > value_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef value_type reference;
+	typedef std::vector<hunk>::const_iterator hunk_iterator;
+
+	class pointer
+	{
+	public:
+		explicit pointer(const value_type& iValue): _value(iValue) {}
+
+		const value_type* operator->() const
+		{
+			return &_value;
+		}
+
+	private:
+		value_type _value;
+	};
+
+	flat_iterator(): _hunkIt(), _begin1(), _begin2() {}
+	flat_iterator(hunk_iterator iHunkIt, Iterator iBegin1, Iterator iBegin2):
+		_hunkIt(iHunkIt), _begin1(iBegin1), _begin2(iBegin2) {}
+
+	reference operator*() const
+	{
+		const hunk& aHunk = *_hunkIt;
+		const Iterator aBegin(aHunk._operation.isInsert() ? _begin2 + aHunk._pos2 : _begin1 + aHunk._pos1);
+		return value_type(aHunk._operation, range<Iterator>(aBegin, aBegin + aHunk._length));
+	}
+
+	pointer operator->() const
+	{
+		return pointer(**this);
+	}
+
+	reference operator[](difference_type iOffset) const
+	{
+		return *(*this + iOffset);
+	}
+
+	//! Underlying record of the current hunk.
+	const hunk& record() const
+	{
+		return *_hunkIt;
+	}
+
+	flat_iterator& operator++()
+	{
+		++_hunkIt;
+		return *this;
+	}
+
+	flat_iterator operator++(int)
+	{
+		flat_iterator aTmp(*this);
+		++_hunkIt;
+		return aTmp;
+	}
+
+	flat_iterator& operator--()
+	{
+		--_hunkIt;
+		return *this;
+	}
+
+	flat_iterator operator--(int)
+	{
+		flat_iterator aTmp(*this);
+		--_hunkIt;
+		return aTmp;
+	}
+
+	flat_iterator& operator+=(difference_type iOffset)
+	{
+		_hunkIt += iOffset;
+		return *this;
+	}
+
+	flat_iterator& operator-=(difference_type iOffset)
+	{
+		_hunkIt -= iOffset;
+		return *this;
+	}
+
+	flat_iterator operator+(difference_type iOffset) const
+	{
+		return flat_iterator(_hunkIt + iOffset, _begin1, _begin2);
+	}
+
+	flat_iterator operator-(difference_type iOffset) const
+	{
+		return flat_iterator(_hunkIt - iOffset, _begin1, _begin2);
+	}
+
+	difference_type operator-(const flat_iterator& iOther) const
+	{
+		return _hunkIt - iOther._hunkIt;
+	}
+
+	bool operator==(const flat_iterator& iOther) const
+	{
+		return _hunkIt == iOther._hunkIt;
+	}
+
+	bool operator!=(const flat_iterator& iOther) const
+	{
+		return _hunkIt != iOther._hunkIt;
+	}
+
+	bool operator<(const flat_iterator& iOther) const
+	{
+		return _hunkIt < iOther._hunkIt;
+	}
+
+	bool operator>(const flat_iterator& iOther) const
+	{
+		return _hunkIt > iOther._hunkIt;
+	}
+
+	bool operator<=(const flat_iterator& iOther) const
+	{
+		return _hunkIt <= iOther._hunkIt;
+	}
+
+	bool operator>=(const flat_iterator& iOther) const
+	{
+		return _hunkIt >= iOther._hunkIt;
+	}
+
+private:
+	hunk_iterator _hunkIt;
+	Iterator _begin1;
+	Iterator _begin2;
+};
+
+/*! Visitor appending streamed hunks as flat records.
+ */
+template<typename Iterator>
+class hunk_appender
+{
+public:
+	hunk_appender(std::vector<hunk>& oHunks, stats& oStats): _hunks(oHunks), _stats(oStats), _pos1(0), _pos2(0) {}
+
+	void on_equal(Iterator iBegin, Iterator iEnd)
+	{
+		const size_t aLength = std::distance(iBegin, iEnd);
+		_hunks.push_back(hunk(operation::equal(), _pos1, _pos2, aLength));
+		_stats.add(operation::equal(), aLength);
+		_pos1 += aLength;
+		_pos2 += aLength;
+	}
+
+	void on_remove(Iterator iBegin, Iterator iEnd)
+	{
+		const size_t aLength = std::distance(iBegin, iEnd);
+		_hunks.push_back(hunk(operation::remove(), _pos1, _pos2, aLength));
+		_stats.add(operation::remove(), aLength);
+		_pos1 += aLength;
+	}
+
+	void on_insert(Iterator iBegin, Iterator iEnd)
+	{
+		const size_t aLength = std::distance(iBegin, iEnd);
+		_hunks.push_back(hunk(operation::insert(), _pos1, _pos2, aLength));
+		_stats.add(operation::insert(), aLength);
+		_pos2 += aLength;
+	}
+
+private:
+	std::vector<hunk>& _hunks;
+	stats& _stats;
+	size_t _pos1;
+	size_t _pos2;
+};
+
+}  // namespace detail
+
+/*! Edit script stored as a contiguous vector of hunk records.
+ *
+ * Hunks do not own any elements, they reference the diffed ranges which
+ * must outlive the result. Iteration yields (operation, view) pairs with
+ * the same shape as result<Range>.
+ */
+template<typename Range, typename Traits = detail::range_traits<Range> >
+class flat_result
+{
+public:
+	typedef typename Range::const_iterator range_iterator;
+	typedef range<range_iterator> view_type;
+	typedef std::pair<operation, view_type> value_type;
+	typedef typename Range::value_type element_type;
+	typedef std::vector<hunk> container_type;
+	typedef detail::flat_iterator<range_iterator> const_iterator;
+	typedef diff::patch<const_iterator> patch_type;
+	typedef const_iterator iterator;
+	typedef std::list<std::pair<operation, Range> > list_type;
+
+	flat_result(): _owning(true)
+	{
+		bind_storage();
+	}
+
+	flat_result(const Range& iRange1, const Range& iRange2):
+		_range1(iRange1.begin(), iRange1.end()), _range2(iRange2.begin(), iRange2.end()), _owning(false) {}
+
+#if __cplusplus >= 201103L
+	//! Takes ownership of both ranges, hunks reference the moved-in storage.
+	flat_result(Range&& iRange1, Range&& iRange2):
+		_storage1(std::move(iRange1)), _storage2(std::move(iRange2)), _owning(true)
+	{
+		bind_storage();
+	}
+#endif
+
+	flat_result(const flat_result& iOther):
+		_storage1(iOther._storage1), _storage2(iOther._storage2),
+		_range1(iOther._range1), _range2(iOther._range2),
+		_hunks(iOther._hunks), _stats(iOther._stats), _owning(iOther._owning)
+	{
+		if(_owning)
+		{
+			bind_storage();
+		}
+	}
+
+	flat_result& operator=(const flat_result& iOther)
+	{
+		if(this != &iOther)
+		{
+			_storage1 = iOther._storage1;
+			_storage2 = iOther._storage2;
+			_range1 = iOther._range1;
+			_range2 = iOther._range2;
+			_hunks = iOther._hunks;
+			_stats = iOther._stats;
+			_owning = iOther._owning;
+			if(_owning)
+			{
+				bind_storage();
+			}
+		}
+		return *this;
+	}
+
+#if __cplusplus >= 201103L
+	//! Takes over the hunks and the ranges, iOther is left empty.
+	flat_result(flat_result&& ioOther): _owning(true)
+	{
+		bind_storage();
+		swap(ioOther);
+	}
+
+	flat_result& operator=(flat_result&& ioOther)
+	{
+		if(this != &ioOther)
+		{
+			flat_result aMoved(std::move(ioOther));
+			swap(aMoved);
+		}
+		return *this;
+	}
+#endif
+
+	//! Owned storage is swapped too, views into it are bound again.
+	void swap(flat_result& ioOther)
+	{
+		std::swap(_storage1, ioOther._storage1);
+		std::swap(_storage2, ioOther._storage2);
+		std::swap(_range1, ioOther._range1);
+		std::swap(_range2, ioOther._range2);
+		_hunks.swap(ioOther._hunks);
+		std::swap(_stats, ioOther._stats);
+		std::swap(_owning, ioOther._owning);
+		if(_owning)
+		{
+			bind_storage();
+		}
+		if(ioOther._owning)
+		{
+			ioOther.bind_storage();
+		}
+	}
+
+	/*! Takes over the content of both ranges without copying any elements,
+	 *  the ranges are left empty. Previous hunks are dropped.
+	 */
+	void adopt(Range& ioRange1, Range& ioRange2)
+	{
+		_storage1.swap(ioRange1);
+		_storage2.swap(ioRange2);
+		_owning = true;
+		bind_storage();
+		_hunks.clear();
+		_stats = diff::stats();
+	}
+
+	//! Moves the hunk records out of the result leaving it empty.
+	container_type release()
+	{
+		container_type aHunks;
+		aHunks.swap(_hunks);
+		_stats = diff::stats();
+		return aHunks;
+	}
+
+	//! Streams the diff of the bound ranges directly into hunk records.
+	void calculate(const options& iOptions = options())
+	{
+		_hunks.clear();
+		_stats = diff::stats();
+		detail::hunk_appender<range_iterator> anAppender(_hunks, _stats);
+		detail::visitor_sink<detail::hunk_appender<range_iterator>, range_iterator> aSink(anAppender, _range1.begin(), _range2.begin());
+		detail::calculate_hunks<Traits>(_range1.begin(), _range1.end(), _range2.begin(), _range2.end(), aSink, iOptions);
+		aSink.flush();
+	}
+
+	/*! Flattens list based result of the bound ranges.
+	 *
+	 * @param iResult hunks in the shape of result<Range>
+	 */
+	template<typename Result>
+	void assign(const Result& iResult)
+	{
+		_hunks.clear();
+		_hunks.reserve(iResult.size());
+		_stats = diff::stats();
+
+		size_t aPos1(0);
+		size_t aPos2(0);
+		typename Result::const_iterator aResultEnd = iResult.end();
+		for(typename Result::const_iterator aResultIt = iResult.begin(); aResultIt != aResultEnd; ++aResultIt)
+		{
+			const size_t aLength = aResultIt->second.size();
+			if(aLength == 0)
+			{
+				continue;
+			}
+			_hunks.push_back(hunk(aResultIt->first, aPos1, aPos2, aLength));
+			_stats.add(aResultIt->first, aLength);
+			if(!aResultIt->first.isInsert())
+			{
+				aPos1 += aLength;
+			}
+			if(!aResultIt->first.isRemove())
+			{
+				aPos2 += aLength;
+			}
+		}
+	}
+
+	/*! Diff of A and C composed of the diffs of A and B and of B and C,
+	 *  in one pass over both without diffing again.
+	 *
+	 * Hunks reference the first range of iFirst and the second range of
+	 * iSecond. Both are copied if either result owns its ranges. The B of
+	 * both diffs must be the same, see detail::compose().
+	 *
+	 * @return false if the lengths of their Bs differ, the result is left
+	 *         unchanged then
+	 */
+	bool compose(const flat_result& iFirst, const flat_result& iSecond)
+	{
+		container_type aHunks;
+		diff::stats aStats;
+		detail::hunk_appender<range_iterator> anAppender(aHunks, aStats);
+		detail::visitor_sink<detail::hunk_appender<range_iterator>, range_iterator> aSink(anAppender,
+				iFirst._range1.begin(), iSecond._range2.begin());
+		if(!detail::compose(iFirst.begin(), iFirst.end(), iSecond.begin(), iSecond.end(), aSink))
+		{
+			return false;
+		}
+		aSink.flush();
+
+		if(iFirst._owning || iSecond._owning)
+		{
+			Range aStorage1(iFirst._range1.begin(), iFirst._range1.end());
+			Range aStorage2(iSecond._range2.begin(), iSecond._range2.end());
+			_storage1.swap(aStorage1);
+			_storage2.swap(aStorage2);
+			_owning = true;
+			bind_storage();
+		}
+		else
+		{
+			_range1 = iFirst._range1;
+			_range2 = iSecond._range2;
+			Range().swap(_storage1);
+			Range().swap(_storage2);
+			_owning = false;
+		}
+		_hunks.swap(aHunks);
+		_stats = aStats;
+		return true;
+	}
+
+	/*! Turns the diff of A and B into the diff of B and A.
+	 *
+	 * A removal followed by an insertion swaps their lengths instead, so
+	 * normalised hunks stay normalised.
+	 */
+	void invert()
+	{
+		std::swap(_range1, _range2);
+		_storage1.swap(_storage2);
+		if(_owning)
+		{
+			bind_storage();
+		}
+
+		for(container_type::iterator aHunkIt = _hunks.begin(); aHunkIt != _hunks.end(); ++aHunkIt)
+		{
+			if(aHunkIt->_operation.isEqual())
+			{
+				continue;
+			}
+			const container_type::iterator aNextIt = aHunkIt + 1;
+			if(aHunkIt->_operation.isRemove() && (aNextIt != _hunks.end()) && aNextIt->_operation.isInsert())
+			{
+				std::swap(aHunkIt->_length, aNextIt->_length);
+				aHunkIt = aNextIt;
+			}
+			else
+			{
+				aHunkIt->_operation = aHunkIt->_operation.isRemove() ? operation::insert() : operation::remove();
+			}
+		}
+
+		_stats = diff::stats();
+		size_t aPos1(0);
+		size_t aPos2(0);
+		for(container_type::iterator aHunkIt = _hunks.begin(); aHunkIt != _hunks.end(); ++aHunkIt)
+		{
+			aHunkIt->_pos1 = aPos1;
+			aHunkIt->_pos2 = aPos2;
+			_stats.add(aHunkIt->_operation, aHunkIt->_length);
+			if(!aHunkIt->_operation.isInsert())
+			{
+				aPos1 += aHunkIt->_length;
+			}
+			if(!aHunkIt->_operation.isRemove())
+			{
+				aPos2 += aHunkIt->_length;
+			}
+		}
+	}
+
+	//! Converts hunks back to the list of owned ranges used by result<Range>.
+	list_type to_list() const
+	{
+		list_type aList;
+		const const_iterator anEnd = end();
+		for(const_iterator anIt = begin(); anIt != anEnd; ++anIt)
+		{
+			const value_type aValue(*anIt);
+			aList.push_back(std::make_pair(aValue.first, Range(aValue.second.begin(), aValue.second.end())));
+		}
+		return aList;
+	}
+
+public:
+	const_iterator begin() const
+	{
+		return const_iterator(_hunks.begin(), _range1.begin(), _range2.begin());
+	}
+
+	const_iterator end() const
+	{
+		return const_iterator(_hunks.end(), _range1.begin(), _range2.begin());
+	}
+
+	value_type operator[](size_t iIndex) const
+	{
+		return begin()[iIndex];
+	}
+
+	const container_type& hunks() const
+	{
+		return _hunks;
+	}
+
+	//! Statistics gathered while the hunks were appended.
+	const diff::stats& stats() const
+	{
+		return _stats;
+	}
+
+	//! Appends patches with iMargin elements of context, see diff::make_patches().
+	template<typename Patches>
+	void make_patches(Patches& oPatches, size_t iMargin = kDefaultPatchMargin) const
+	{
+		diff::make_patches(begin(), end(), oPatches, iMargin);
+	}
+
+	container_type::size_type size() const
+	{
+		return _hunks.size();
+	}
+
+	bool empty() const
+	{
+		return _hunks.empty();
+	}
+
+private:
+	void bind_storage()
+	{
+		const Range& aStorage1 = _storage1;
+		const Range& aStorage2 = _storage2;
+		_range1 = view_type(aStorage1.begin(), aStorage1.end());
+		_range2 = view_type(aStorage2.begin(), aStorage2.end());
+	}
+
+	Range _storage1;
+	Range _storage2;
+	view_type _range1;
+	view_type _range2;
+	container_type _hunks;
+	diff::stats _stats;
+	bool _owning;
+};
+
+}  // namespace diff
+}  // namespace izi
+
+#endif /* IZI_DIFF_FLAT_RESULT_H_ */
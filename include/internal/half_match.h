@@ -0,0 +1,107 @@
+#ifndef DIFF_HALF_MATCH_H_
+#define DIFF_HALF_MATCH_H_
+
+#include "algorithm.h"
+#include "operation.h"
+#include "types.h"
+
+namespace izi {
+namespace diff {
+namespace detail {
+
+template<typename Traits, typename Iterator, typename Result>
+void calculate_hunks(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult,
+		const options& iOptions);
+
+//! Range common to the long and the short range.
+template<typename Iterator>
+struct common_range
+{
+	common_range(): _longIt(), _shortIt(), _size(0) {}
+
+	Iterator _longIt;
+	Iterator _shortIt;
+	size_t _size;
+};
+
+/*! Longest common range containing the quarter of the long range starting
+ *  at iSeedIt.
+ *
+ * Every occurrence of the seed in the short range is extended to both sides.
+ */
+template<typename Iterator>
+common_range<Iterator> half_match_seed(Iterator iLongBegin, Iterator iLongEnd,
+		Iterator iShortBegin, Iterator iShortEnd, Iterator iSeedIt)
+{
+	const Iterator aSeedEnd = detail::next(iSeedIt, std::distance(iLongBegin, iLongEnd) / 4);
+	common_range<Iterator> aBest;
+	for(Iterator aFoundIt = find_subrange(iShortBegin, iShortEnd, iSeedIt, aSeedEnd); aFoundIt != iShortEnd;
+			aFoundIt = find_subrange(detail::next(aFoundIt), iShortEnd, iSeedIt, aSeedEnd))
+	{
+		const size_t aPfxSize = std::distance(iSeedIt, common_prefix(iSeedIt, iLongEnd, aFoundIt, iShortEnd));
+		const size_t aSfxSize = std::distance(common_suffix(iLongBegin, iSeedIt, iShortBegin, aFoundIt), iSeedIt);
+		if(aPfxSize + aSfxSize > aBest._size)
+		{
+			aBest._longIt = detail::prior(iSeedIt, aSfxSize);
+			aBest._shortIt = detail::prior(aFoundIt, aSfxSize);
+			aBest._size = aPfxSize + aSfxSize;
+		}
+	}
+	return aBest;
+}
+
+/*! Splits the ranges around a common range at least half as long as the
+ *  longer one and diffs both sides of it.
+ *
+ * Such a common range contains the second or the third quarter of the
+ * longer range, which are searched in the shorter one as seeds. The diff
+ * found may not be minimal, so it is skipped for minimal options.
+ *
+ * @return false if the ranges share no such common range
+ */
+template<typename Traits, typename Iterator, typename Result>
+bool half_match(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult,
+		const options& iOptions)
+{
+	typedef typename Result::value_type::second_type range_type;
+
+	const size_t aSize1 = std::distance(iBegin1, iEnd1);
+	const size_t aSize2 = std::distance(iBegin2, iEnd2);
+	const bool aFirstLonger(aSize1 > aSize2);
+	const size_t aLongSize(aFirstLonger ? aSize1 : aSize2);
+	if(iOptions._minimal || (aLongSize < 4) || (2 * (aFirstLonger ? aSize2 : aSize1) < aLongSize))
+	{
+		return false;
+	}
+
+	const Iterator aLongBegin(aFirstLonger ? iBegin1 : iBegin2);
+	const Iterator aLongEnd(aFirstLonger ? iEnd1 : iEnd2);
+	const Iterator aShortBegin(aFirstLonger ? iBegin2 : iBegin1);
+	const Iterator aShortEnd(aFirstLonger ? iEnd2 : iEnd1);
+	common_range<Iterator> aCommon = half_match_seed(aLongBegin, aLongEnd, aShortBegin, aShortEnd,
+			detail::next(aLongBegin, (aLongSize + 3) / 4));
+	const common_range<Iterator> aCommon2 = half_match_seed(aLongBegin, aLongEnd, aShortBegin, aShortEnd,
+			detail::next(aLongBegin, (aLongSize + 1) / 2));
+	if(aCommon2._size > aCommon._size)
+	{
+		aCommon = aCommon2;
+	}
+	if(2 * aCommon._size < aLongSize)
+	{
+		return false;
+	}
+
+	const Iterator aCommonIt1(aFirstLonger ? aCommon._longIt : aCommon._shortIt);
+	const Iterator aCommonIt2(aFirstLonger ? aCommon._shortIt : aCommon._longIt);
+	const Iterator aCommonEnd1(detail::next(aCommonIt1, aCommon._size));
+	calculate_hunks<Traits>(iBegin1, aCommonIt1, iBegin2, aCommonIt2, oResult, iOptions);
+	oResult.push_back(std::make_pair(operation::equal(), range_type(aCommonIt1, aCommonEnd1)));
+	calculate_hunks<Traits>(aCommonEnd1, iEnd1, detail::next(aCommonIt2, aCommon._size), iEnd2, oResult, iOptions);
+	return true;
+}
+
+}  // namespace detail
+}  // namespace diff
+}  // namespace izi
+
+#endif /* DIFF_HALF_MATCH_H_ */
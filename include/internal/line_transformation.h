@@ -1,6 +1,10 @@
 #ifndef DIFF_LINE_TRANSFORMATION_H_
 #define DIFF_LINE_TRANSFORMATION_H_
 
+#include <algorithm>
+#include <list>
+
+#include "operation.h"
 #include "types.h"
 
 namespace izi {
@@ -8,13 +12,18 @@ namespace diff {
 namespace detail {
 
 template<typename Traits, typename Iterator, typename Result>
-void calculate(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult);
+void calculate_hunks(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult,
+		const options& iOptions);
 
-template<typename Traits, typename Iterator>
+template<typename Traits, typename Iterator, typename Result>
+void calculate(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2, Result& oResult,
+		const options& iOptions);
+
+template<typename Traits, typename Iterator, typename LineVector, typename LineCont, typename LineMap>
 void line_transform(Iterator iBegin, Iterator iEnd,
-		line_vector& oRange,
-		typename range_vector<Iterator>::type& oLines,
-		typename line_map<Iterator>::type& oLinesMap)
+		LineVector& oRange,
+		LineCont& oLines,
+		LineMap& oLinesMap)
 {
 	Iterator aEndl = std::find(iBegin, iEnd, Traits::endl());
 
@@ -26,7 +35,7 @@ void line_transform(Iterator iBegin, Iterator iEnd,
 		}
 		range<Iterator> aLine(iBegin, aEndl);
 
-		typename line_map<Iterator>::type::const_iterator aLineIt = oLinesMap.find(aLine);
+		typename LineMap::const_iterator aLineIt = oLinesMap.find(aLine);
 		if(aLineIt != oLinesMap.end())
 		{
 			oRange.push_back(aLineIt->second);
@@ -43,102 +52,100 @@ void line_transform(Iterator iBegin, Iterator iEnd,
 	}
 }
 
-template<typename Traits, typename Iterator>
+template<typename Traits, typename Iterator, typename LineVector, typename LineCont>
 void line_transform(Iterator iBegin1, Iterator iEnd1,
 		Iterator iBegin2, Iterator iEnd2,
-		line_vector& oRange1, line_vector& oRange2,
-		typename range_vector<Iterator>::type& oLines)
+		LineVector& oRange1, LineVector& oRange2,
+		LineCont& oLines)
 {
-	typename line_map<Iterator>::type aLinesMap;
+	typedef typename line_map<Iterator, typename LineCont::allocator_type>::type line_map_type;
+
+	line_map_type aLinesMap(typename line_map_type::key_compare(), oLines.get_allocator());
 	line_transform<Traits>(iBegin1, iEnd1, oRange1, oLines, aLinesMap);
 	line_transform<Traits>(iBegin2, iEnd2, oRange2, oLines, aLinesMap);
 }
 
-template<typename TrResult, typename Result, typename LineCont>
-void reverse_transform(const TrResult iTrResult, Result& oResult, const LineCont& iLines)
+template<typename Traits, typename Iterator>
+Iterator skip_lines(Iterator iBegin, Iterator iEnd, size_t iCount)
 {
-	typedef typename Result::value_type::second_type range_type;
-
-	// Perform reverse transformation of the line diff result
-	typename TrResult::const_iterator aTrEnd = iTrResult.end();
-	for(typename TrResult::const_iterator aTrIt = iTrResult.begin(); aTrIt != aTrEnd; ++aTrIt)
+	for(; (iCount > 0) && (iBegin != iEnd); --iCount)
 	{
-		oResult.push_back(std::make_pair(aTrIt->first, range_type()));
-		range_type& aRange = oResult.back().second;
-
-		line_vector::const_iterator aLineEnd = aTrIt->second.end();
-		for(line_vector::const_iterator aLineIt = aTrIt->second.begin(); aLineIt != aLineEnd; ++aLineIt)
+		iBegin = std::find(iBegin, iEnd, Traits::endl());
+		if(iBegin != iEnd)
 		{
-			const typename LineCont::value_type& aLine = iLines[*aLineIt];
-			std::copy(aLine._begin, aLine._end, std::back_inserter(aRange));
+			++iBegin;
 		}
 	}
+	return iBegin;
 }
 
-template<typename Result>
-void cleanup_transformation(Result& oResult)
+template<typename Traits, typename TrResult, typename Iterator, typename Result>
+void reverse_transform(const TrResult& iTrResult,
+		Iterator iBegin1, Iterator iEnd1,
+		Iterator iBegin2, Iterator iEnd2, Result& oResult, const options& iOptions)
 {
 	typedef typename Result::value_type::second_type range_type;
 
-	oResult.push_back(std::make_pair(operation::equal(), range_type()));
-	range_type aInserted;
-	range_type aRemoved;
-	unsigned long aInsertedCnt(0);
-	unsigned long aRemovedCnt(0);
-	typename Result::iterator aResultIt = oResult.begin();
-	while(aResultIt != oResult.end())
+	// Map the line diff result back on the original ranges. Lines removed and
+	// inserted between two equalities are diffed once more element by element.
+	Iterator anIt1 = iBegin1;
+	Iterator anIt2 = iBegin2;
+	Iterator aChangeIt1 = iBegin1;
+	Iterator aChangeIt2 = iBegin2;
+	typename TrResult::const_iterator aTrEnd = iTrResult.end();
+	for(typename TrResult::const_iterator aTrIt = iTrResult.begin(); aTrIt != aTrEnd; ++aTrIt)
 	{
-		if(aResultIt->first.isInsert())
+		const size_t aLineCnt = aTrIt->second.size();
+		if(aTrIt->first.isEqual())
 		{
-			++aInsertedCnt;
-			std::copy(aResultIt->second.begin(), aResultIt->second.end(), std::back_inserter(aInserted));
+			if((aChangeIt1 != anIt1) || (aChangeIt2 != anIt2))
+			{
+				calculate_hunks<void_traits>(aChangeIt1, anIt1, aChangeIt2, anIt2, oResult, iOptions);
+			}
+			Iterator anEqualEnd = skip_lines<Traits>(anIt1, iEnd1, aLineCnt);
+			oResult.push_back(std::make_pair(operation::equal(), range_type(anIt1, anEqualEnd)));
+			std::advance(anIt2, std::distance(anIt1, anEqualEnd));
+			anIt1 = anEqualEnd;
+			aChangeIt1 = anIt1;
+			aChangeIt2 = anIt2;
 		}
-		else if(aResultIt->first.isRemove())
+		else if(aTrIt->first.isRemove())
 		{
-			++aRemovedCnt;
-			std::copy(aResultIt->second.begin(), aResultIt->second.end(), std::back_inserter(aRemoved));
+			anIt1 = skip_lines<Traits>(anIt1, iEnd1, aLineCnt);
 		}
-		else if(aResultIt->first.isEqual())
+		else
 		{
-			if((aInsertedCnt > 0) && (aRemovedCnt > 0))
-			{
-				oResult.erase(next(aResultIt, - (aInsertedCnt + aRemovedCnt)), aResultIt);
-				Result aResult;
-				calculate<void_traits>(aRemoved.begin(), aRemoved.end(), aInserted.begin(), aInserted.end(), aResult);
-				oResult.splice(aResultIt, aResult);
-			}
-			aInsertedCnt = 0;
-			aRemovedCnt = 0;
-			aInserted.clear();
-			aRemoved.clear();
+			anIt2 = skip_lines<Traits>(anIt2, iEnd2, aLineCnt);
 		}
-		++aResultIt;
 	}
-	if(oResult.back().second.empty())
+	if((aChangeIt1 != anIt1) || (aChangeIt2 != anIt2))
 	{
-		oResult.pop_back();
+		calculate_hunks<void_traits>(aChangeIt1, anIt1, aChangeIt2, anIt2, oResult, iOptions);
 	}
 }
 
 template<typename Traits, typename Iterator, typename Result>
 void line_diff(Iterator iBegin1, Iterator iEnd1,
-		Iterator iBegin2, Iterator iEnd2, Result& oResult)
+		Iterator iBegin2, Iterator iEnd2, Result& oResult, const options& iOptions)
 {
-	line_vector aTransform1;
-	line_vector aTransform2;
-	typename range_vector<Iterator>::type aLines;
+	typedef typename Result::allocator_type allocator_type;
+	typedef typename line_index_vector<allocator_type>::type line_vector_type;
+	typedef std::pair<operation, line_vector_type> line_hunk_type;
+
+	const allocator_type anAllocator(oResult.get_allocator());
+	line_vector_type aTransform1(anAllocator);
+	line_vector_type aTransform2(anAllocator);
+	typename range_vector<Iterator, allocator_type>::type aLines(anAllocator);
 
 	// Transform to lines
 	line_transform<Traits>(iBegin1, iEnd1, iBegin2, iEnd2, aTransform1, aTransform2, aLines);
 
 	// Calculate diff on lines
-	std::list<std::pair<operation, line_vector> > aTrResult;
-	calculate<void_traits>(aTransform1.begin(), aTransform1.end(), aTransform2.begin(), aTransform2.end(), aTrResult);
+	std::list<line_hunk_type, typename rebind_allocator<allocator_type, line_hunk_type>::type> aTrResult(anAllocator);
+	calculate<void_traits>(aTransform1.begin(), aTransform1.end(), aTransform2.begin(), aTransform2.end(), aTrResult, iOptions);
 
 	// Perform reverse transformation of the line diff result
-	reverse_transform(aTrResult, oResult, aLines);
-
-	cleanup_transformation(oResult);
+	reverse_transform<Traits>(aTrResult, iBegin1, iEnd1, iBegin2, iEnd2, oResult, iOptions);
 }
 
 }  // namespace detail
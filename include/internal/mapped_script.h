@@ -0,0 +1,324 @@
+#ifndef IZI_DIFF_MAPPED_SCRIPT_H_
+#define IZI_DIFF_MAPPED_SCRIPT_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+
+#include "operation.h"
+
+namespace izi {
+namespace diff {
+
+/* Memory mappable layout of an edit script
+ *
+ * All fields are 8 bytes wide, little endian and 8 byte aligned.
+ *
+ * header   magic "IZDF", version (4 bytes), hunk count, old size, new size
+ * records  one per hunk: operation, old position, new position, length,
+ *          payload offset (from the start of the buffer, 0 if none)
+ * payload  inserted elements in their native representation, each block
+ *          padded to 8 bytes
+ *
+ * Equal and removed elements are not stored, they are resolved against
+ * the old range. Records are ordered, so hunks covering a position of the
+ * old or the new range are found by binary search.
+ */
+
+namespace detail {
+
+const size_t kMappedHeaderSize = 32;
+const size_t kMappedRecordSize = 40;
+const size_t kMappedAlignment = 8;
+const unsigned kMappedVersion = 1;
+
+inline size_t mapped_align(size_t iSize)
+{
+	return (iSize + kMappedAlignment - 1) & ~(kMappedAlignment - 1);
+}
+
+template<typename OutputIterator>
+OutputIterator write_field(size_t iValue, OutputIterator oOutput)
+{
+	for(size_t i = 0; i < 8; ++i)
+	{
+		*oOutput = static_cast<char>(i < sizeof(size_t) ? (iValue >> (i * 8)) & 0xFF : 0);
+		++oOutput;
+	}
+	return oOutput;
+}
+
+template<typename OutputIterator>
+OutputIterator write_padding(size_t iSize, OutputIterator oOutput)
+{
+	for(size_t i = mapped_align(iSize); i > iSize; --i)
+	{
+		*oOutput = 0;
+		++oOutput;
+	}
+	return oOutput;
+}
+
+inline size_t read_field(const unsigned char* iField)
+{
+	size_t aValue(0);
+	for(size_t i = 0; i < sizeof(size_t) && i < 8; ++i)
+	{
+		aValue |= static_cast<size_t>(iField[i]) << (i * 8);
+	}
+	return aValue;
+}
+
+}  // namespace detail
+
+/*! Size of the mapped layout written by write_mapped().
+ */
+template<typename Result>
+size_t mapped_size(const Result& iResult)
+{
+	typedef typename Result::value_type::second_type::value_type element_type;
+
+	size_t aSize(detail::kMappedHeaderSize);
+	typename Result::const_iterator aResultEnd = iResult.end();
+	for(typename Result::const_iterator aResultIt = iResult.begin(); aResultIt != aResultEnd; ++aResultIt)
+	{
+		typename std::iterator_traits<typename Result::const_iterator>::reference aHunk(*aResultIt);
+		if(!aHunk.second.empty())
+		{
+			aSize += detail::kMappedRecordSize;
+			if(aHunk.first.isInsert())
+			{
+				aSize += detail::mapped_align(aHunk.second.size() * sizeof(element_type));
+			}
+		}
+	}
+	return aSize;
+}
+
+/*! Writes the edit script in the memory mappable layout.
+ *
+ * @param iResult result or flat_result
+ * @param oOutput output iterator accepting chars
+ * @return output iterator past the last written byte
+ */
+template<typename Result, typename OutputIterator>
+OutputIterator write_mapped(const Result& iResult, OutputIterator oOutput)
+{
+	typedef typename Result::value_type::second_type::value_type element_type;
+	typedef typename Result::const_iterator const_iterator;
+
+	const const_iterator aResultEnd = iResult.end();
+	size_t aCount(0);
+	size_t anOldSize(0);
+	size_t aNewSize(0);
+	for(const_iterator aResultIt = iResult.begin(); aResultIt != aResultEnd; ++aResultIt)
+	{
+		const size_t aLength = (*aResultIt).second.size();
+		if(aLength > 0)
+		{
+			++aCount;
+			anOldSize += (*aResultIt).first.isInsert() ? 0 : aLength;
+			aNewSize += (*aResultIt).first.isRemove() ? 0 : aLength;
+		}
+	}
+
+	*oOutput = 'I'; ++oOutput;
+	*oOutput = 'Z'; ++oOutput;
+	*oOutput = 'D'; ++oOutput;
+	*oOutput = 'F'; ++oOutput;
+	for(size_t i = 0; i < 4; ++i, ++oOutput)
+	{
+		*oOutput = static_cast<char>((detail::kMappedVersion >> (i * 8)) & 0xFF);
+	}
+	oOutput = detail::write_field(aCount, oOutput);
+	oOutput = detail::write_field(anOldSize, oOutput);
+	oOutput = detail::write_field(aNewSize, oOutput);
+
+	// Records
+	size_t aPayloadOffset(detail::kMappedHeaderSize + aCount * detail::kMappedRecordSize);
+	size_t aPos1(0);
+	size_t aPos2(0);
+	for(const_iterator aResultIt = iResult.begin(); aResultIt != aResultEnd; ++aResultIt)
+	{
+		typename std::iterator_traits<typename Result::const_iterator>::reference aHunk(*aResultIt);
+		const size_t aLength = aHunk.second.size();
+		if(aLength == 0)
+		{
+			continue;
+		}
+		oOutput = detail::write_field(aHunk.first.value(), oOutput);
+		oOutput = detail::write_field(aPos1, oOutput);
+		oOutput = detail::write_field(aPos2, oOutput);
+		oOutput = detail::write_field(aLength, oOutput);
+		oOutput = detail::write_field(aHunk.first.isInsert() ? aPayloadOffset : 0, oOutput);
+		if(aHunk.first.isInsert())
+		{
+			aPayloadOffset += detail::mapped_align(aLength * sizeof(element_type));
+		}
+		aPos1 += aHunk.first.isInsert() ? 0 : aLength;
+		aPos2 += aHunk.first.isRemove() ? 0 : aLength;
+	}
+
+	// Payload
+	for(const_iterator aResultIt = iResult.begin(); aResultIt != aResultEnd; ++aResultIt)
+	{
+		typename std::iterator_traits<typename Result::const_iterator>::reference aHunk(*aResultIt);
+		if(!aHunk.first.isInsert() || aHunk.second.empty())
+		{
+			continue;
+		}
+		typename Result::value_type::second_type::const_iterator anEnd = aHunk.second.end();
+		for(typename Result::value_type::second_type::const_iterator anIt = aHunk.second.begin(); anIt != anEnd; ++anIt)
+		{
+			const element_type anElement(*anIt);
+			const char* aBytes = reinterpret_cast<const char*>(&anElement);
+			oOutput = std::copy(aBytes, aBytes + sizeof(element_type), oOutput);
+		}
+		oOutput = detail::write_padding(aHunk.second.size() * sizeof(element_type), oOutput);
+	}
+	return oOutput;
+}
+
+/*! Hunk read from the mapped layout.
+ */
+template<typename Element>
+struct mapped_hunk
+{
+	mapped_hunk(operation iOperation, size_t iPos1, size_t iPos2, size_t iLength, const Element* iPayload):
+		_operation(iOperation), _pos1(iPos1), _pos2(iPos2), _length(iLength), _payload(iPayload) {}
+
+	operation _operation;
+	size_t _pos1;
+	size_t _pos2;
+	size_t _length;
+	//! Inserted elements inside the mapped buffer, null for other operations.
+	const Element* _payload;
+};
+
+/*! Read only access to an edit script in the mapped layout, nothing is copied.
+ *
+ * The buffer (typically an mmap-ed file) must be 8 byte aligned and must
+ * outlive the script.
+ */
+template<typename Element>
+class mapped_script
+{
+public:
+	typedef mapped_hunk<Element> value_type;
+
+	mapped_script(const void* iBuffer, size_t iSize):
+		_buffer(static_cast<const unsigned char*>(iBuffer)), _size(iSize), _count(0), _valid(false)
+	{
+		if(valid_header())
+		{
+			_count = detail::read_field(_buffer + 8);
+			_valid = _count <= (_size - detail::kMappedHeaderSize) / detail::kMappedRecordSize;
+			if(!_valid)
+			{
+				_count = 0;
+			}
+		}
+	}
+
+	//! Checks the header and that all records fit the buffer.
+	bool valid() const
+	{
+		return _valid;
+	}
+
+	size_t size() const
+	{
+		return _count;
+	}
+
+	bool empty() const
+	{
+		return _count == 0;
+	}
+
+	size_t old_size() const
+	{
+		return _valid ? detail::read_field(_buffer + 16) : 0;
+	}
+
+	size_t new_size() const
+	{
+		return _valid ? detail::read_field(_buffer + 24) : 0;
+	}
+
+	//! Hunk at the index, payload is null if it does not fit the buffer.
+	value_type operator[](size_t iIndex) const
+	{
+		const unsigned char* aRecord = record(iIndex);
+		const size_t aLength = detail::read_field(aRecord + 24);
+		const size_t anOffset = detail::read_field(aRecord + 32);
+		const Element* aPayload(0);
+		if((anOffset != 0) && (anOffset <= _size) && (aLength <= (_size - anOffset) / sizeof(Element)))
+		{
+			aPayload = reinterpret_cast<const Element*>(_buffer + anOffset);
+		}
+		return value_type(static_cast<detail::OPERATION>(detail::read_field(aRecord)),
+				detail::read_field(aRecord + 8), detail::read_field(aRecord + 16), aLength, aPayload);
+	}
+
+	//! Index of the hunk covering the position of the old range, size() if none.
+	size_t find_old(size_t iPos) const
+	{
+		return find(iPos, 8, old_size());
+	}
+
+	//! Index of the hunk covering the position of the new range, size() if none.
+	size_t find_new(size_t iPos) const
+	{
+		return find(iPos, 16, new_size());
+	}
+
+private:
+	bool valid_header() const
+	{
+		return (_buffer != 0) && (_size >= detail::kMappedHeaderSize) &&
+				(std::memcmp(_buffer, "IZDF", 4) == 0) &&
+				(_buffer[4] == detail::kMappedVersion) && (_buffer[5] == 0) && (_buffer[6] == 0) && (_buffer[7] == 0);
+	}
+
+	const unsigned char* record(size_t iIndex) const
+	{
+		return _buffer + detail::kMappedHeaderSize + iIndex * detail::kMappedRecordSize;
+	}
+
+	size_t find(size_t iPos, size_t iField, size_t iRangeSize) const
+	{
+		const size_t aCount = _count;
+		if(iPos >= iRangeSize)
+		{
+			return aCount;
+		}
+		// Last hunk starting at or before the position
+		size_t aLow(0);
+		size_t aHigh(aCount);
+		while(aLow < aHigh)
+		{
+			const size_t aMid = aLow + (aHigh - aLow) / 2;
+			if(detail::read_field(record(aMid) + iField) <= iPos)
+			{
+				aLow = aMid + 1;
+			}
+			else
+			{
+				aHigh = aMid;
+			}
+		}
+		return (aLow > 0) ? aLow - 1 : aCount;
+	}
+
+	const unsigned char* _buffer;
+	size_t _size;
+	size_t _count;
+	bool _valid;
+};
+
+}  // namespace diff
+}  // namespace izi
+
+#endif /* IZI_DIFF_MAPPED_SCRIPT_H_ */
@@ -0,0 +1,335 @@
+#ifndef IZI_DIFF_MATCH_H_
+#define IZI_DIFF_MATCH_H_
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <iterator>
+#include <map>
+#include <vector>
+
+#include "algorithm.h"
+#include "range_traits.h"
+
+namespace izi {
+namespace diff {
+
+//! Settings of the fuzzy matching.
+struct match_options
+{
+	match_options(): _threshold(0.5), _distance(1000) {}
+	match_options(double iThreshold, size_t iDistance): _threshold(iThreshold), _distance(iDistance) {}
+
+	//! Worst accepted score, 0.0 only accepts exact matches and 1.0 anything.
+	double _threshold;
+	//! Distance from the expected location which costs as much as a
+	//! mismatch of the whole pattern, 0 only accepts the expected location.
+	size_t _distance;
+};
+
+namespace detail {
+
+typedef unsigned long bitap_word;
+
+//! Bits of a bitap word.
+const size_t kBitapWordBits = sizeof(bitap_word) * CHAR_BIT;
+
+//! Bit vectors of patterns fitting in one word.
+struct single_word
+{
+	size_t words() const
+	{
+		return 1;
+	}
+};
+
+//! Bit vectors spanning several words, lowest bits in the first one.
+struct multi_word
+{
+	explicit multi_word(size_t iWords): _words(iWords) {}
+
+	size_t words() const
+	{
+		return _words;
+	}
+
+	size_t _words;
+};
+
+/*! Bit masks of the positions of each element in the pattern, the last
+ *  element in the lowest bit.
+ *
+ * Byte elements are looked up in a table, others in a map of the pattern's
+ * alphabet. Elements outside of the pattern have an empty mask.
+ */
+template<typename Element, bool Byte = byte_element<Element>::value>
+class bitap_alphabet
+{
+public:
+	template<typename Iterator>
+	bitap_alphabet(Iterator iPatternBegin, Iterator iPatternEnd, size_t iWords):
+		_words(iWords), _masks(iWords, 0)
+	{
+		for(size_t anIndex = std::distance(iPatternBegin, iPatternEnd); iPatternBegin != iPatternEnd; ++iPatternBegin)
+		{
+			--anIndex;
+			typename std::map<Element, size_t>::iterator anIt = _indices.find(*iPatternBegin);
+			if(anIt == _indices.end())
+			{
+				anIt = _indices.insert(std::make_pair(*iPatternBegin, _masks.size())).first;
+				_masks.resize(_masks.size() + _words, 0);
+			}
+			_masks[anIt->second + anIndex / kBitapWordBits] |= bitap_word(1) << (anIndex % kBitapWordBits);
+		}
+	}
+
+	const bitap_word* mask(const Element& iElement) const
+	{
+		const typename std::map<Element, size_t>::const_iterator anIt = _indices.find(iElement);
+		return &_masks[(anIt != _indices.end()) ? anIt->second : 0];
+	}
+
+	const bitap_word* none() const
+	{
+		return &_masks[0];
+	}
+
+private:
+	size_t _words;
+	std::map<Element, size_t> _indices;
+	std::vector<bitap_word> _masks;
+};
+
+template<typename Element>
+class bitap_alphabet<Element, true>
+{
+public:
+	template<typename Iterator>
+	bitap_alphabet(Iterator iPatternBegin, Iterator iPatternEnd, size_t iWords):
+		_words(iWords), _masks(257 * iWords, 0)
+	{
+		for(size_t anIndex = std::distance(iPatternBegin, iPatternEnd); iPatternBegin != iPatternEnd; ++iPatternBegin)
+		{
+			--anIndex;
+			_masks[static_cast<unsigned char>(*iPatternBegin) * _words + anIndex / kBitapWordBits] |=
+					bitap_word(1) << (anIndex % kBitapWordBits);
+		}
+	}
+
+	const bitap_word* mask(const Element& iElement) const
+	{
+		return &_masks[static_cast<unsigned char>(iElement) * _words];
+	}
+
+	const bitap_word* none() const
+	{
+		return &_masks[256 * _words];
+	}
+
+private:
+	size_t _words;
+	std::vector<bitap_word> _masks;
+};
+
+/*! Score of a match with iErrors errors at iPosition, lower is better.
+ *
+ * Combines the share of mismatched pattern elements with the distance from
+ * the expected location.
+ */
+inline double bitap_score(size_t iErrors, size_t iPosition, size_t iLocation, size_t iPatternSize,
+		const match_options& iOptions)
+{
+	const double anAccuracy = static_cast<double>(iErrors) / iPatternSize;
+	const size_t aProximity = (iPosition > iLocation) ? iPosition - iLocation : iLocation - iPosition;
+	if(iOptions._distance == 0)
+	{
+		return (aProximity > 0) ? 1.0 : anAccuracy;
+	}
+	return anAccuracy + static_cast<double>(aProximity) / iOptions._distance;
+}
+
+/*! Furthest distance from the location at which a match with iErrors
+ *  errors still scores under the threshold, at most iMax.
+ */
+inline size_t bitap_reach(size_t iErrors, size_t iLocation, size_t iPatternSize, double iThreshold, size_t iMax,
+		const match_options& iOptions)
+{
+	size_t aBinMin = 0;
+	size_t aBinMax = iMax;
+	size_t aBinMid = iMax;
+	while(aBinMin < aBinMid)
+	{
+		if(bitap_score(iErrors, iLocation + aBinMid, iLocation, iPatternSize, iOptions) <= iThreshold)
+		{
+			aBinMin = aBinMid;
+		}
+		else
+		{
+			aBinMax = aBinMid;
+		}
+		aBinMid = (aBinMax - aBinMin) / 2 + aBinMin;
+	}
+	return aBinMid;
+}
+
+/*! Bitap search of the pattern allowing an increasing number of errors,
+ *  see diff-match-patch's match_bitap.
+ *
+ * Each state holds for every pattern prefix if it matches with the current
+ * number of errors, all prefixes advance together with word operations.
+ * Positions examined per error count are bounded by the score threshold.
+ *
+ * @param iThreshold score to beat, e.g. of an exact match found nearby
+ * @return offset of the best match or the size of the text
+ */
+template<typename Iterator, typename Width>
+size_t match_bitap(Iterator iBegin, Iterator iEnd, Iterator iPatternBegin, Iterator iPatternEnd, size_t iLocation,
+		double iThreshold, const match_options& iOptions, Width iWidth)
+{
+	typedef typename std::iterator_traits<Iterator>::value_type element_type;
+
+	const size_t aTextSize = iEnd - iBegin;
+	const size_t aPatternSize = iPatternEnd - iPatternBegin;
+	const size_t aWords = iWidth.words();
+	const bitap_alphabet<element_type> anAlphabet(iPatternBegin, iPatternEnd, aWords);
+	const size_t aMatchWord = (aPatternSize - 1) / kBitapWordBits;
+	const bitap_word aMatchBit = bitap_word(1) << ((aPatternSize - 1) % kBitapWordBits);
+
+	double aThreshold = iThreshold;
+	size_t aBest = aTextSize;
+
+	// Positions examined only shrink with more errors, the states cover the
+	// first round's window [aLow, aHigh] and are indexed from its beginning
+	size_t aBinMax = bitap_reach(0, iLocation, aPatternSize, aThreshold, aPatternSize + aTextSize, iOptions);
+	const size_t aLow = (iLocation + 1 > aBinMax + aPatternSize) ? iLocation + 1 - aBinMax - aPatternSize : 1;
+	const size_t aHigh = std::min(iLocation + aBinMax, aTextSize) + aPatternSize + 1;
+	std::vector<bitap_word> aState((aHigh - aLow + 1) * aWords, 0);
+	std::vector<bitap_word> aLastState(aState.size(), 0);
+	for(size_t anErrors = 0; anErrors < aPatternSize; ++anErrors)
+	{
+		const size_t aBinMid = bitap_reach(anErrors, iLocation, aPatternSize, aThreshold, aBinMax, iOptions);
+		aBinMax = aBinMid;
+		size_t aStart = (iLocation + 1 > aBinMid) ? iLocation - aBinMid + 1 : 1;
+		const size_t aFinish = std::min(iLocation + aBinMid, aTextSize) + aPatternSize;
+		std::fill(aState.begin() + ((aStart - aLow) * aWords), aState.begin() + ((aFinish + 2 - aLow) * aWords), 0);
+		bitap_word* const aFinal = &aState[(aFinish + 1 - aLow) * aWords];
+		for(size_t anIndex = 0; anIndex < anErrors; ++anIndex)
+		{
+			aFinal[anIndex / kBitapWordBits] |= bitap_word(1) << (anIndex % kBitapWordBits);
+		}
+
+		for(size_t aPos = aFinish; aPos >= aStart; --aPos)
+		{
+			const bitap_word* const aMask = (aPos - 1 < aTextSize) ? anAlphabet.mask(iBegin[aPos - 1]) : anAlphabet.none();
+			bitap_word* const aCurrent = &aState[(aPos - aLow) * aWords];
+			const bitap_word* const aNext = aCurrent + aWords;
+			const bitap_word* const aLast = &aLastState[(aPos - aLow) * aWords];
+			const bitap_word* const aLastNext = aLast + aWords;
+
+			// Shifts carry the top bit into the next word, the carry in sets bit 0
+			bitap_word aCarry = 1;
+			bitap_word aLastCarry = 1;
+			for(size_t aWord = 0; aWord < aWords; ++aWord)
+			{
+				const bitap_word aShifted = (aNext[aWord] << 1) | aCarry;
+				aCarry = aNext[aWord] >> (kBitapWordBits - 1);
+				aCurrent[aWord] = aShifted & aMask[aWord];
+				if(anErrors > 0)
+				{
+					const bitap_word aLastBits = aLastNext[aWord] | aLast[aWord];
+					aCurrent[aWord] |= ((aLastBits << 1) | aLastCarry) | aLastNext[aWord];
+					aLastCarry = aLastBits >> (kBitapWordBits - 1);
+				}
+			}
+
+			if((aCurrent[aMatchWord] & aMatchBit) != 0)
+			{
+				const double aScore = bitap_score(anErrors, aPos - 1, iLocation, aPatternSize, iOptions);
+				if(aScore <= aThreshold)
+				{
+					aThreshold = aScore;
+					aBest = aPos - 1;
+					if(aBest <= iLocation)
+					{
+						// Matches further left only score worse
+						break;
+					}
+					aStart = (2 * iLocation > aBest) ? std::max<size_t>(1, 2 * iLocation - aBest) : 1;
+				}
+			}
+		}
+
+		if(bitap_score(anErrors + 1, iLocation, iLocation, aPatternSize, iOptions) > aThreshold)
+		{
+			// No better match with more errors
+			break;
+		}
+		aState.swap(aLastState);
+	}
+	return aBest;
+}
+
+}  // namespace detail
+
+/*! Finds the best fuzzy match of the pattern in the text near iLocationIt,
+ *  see diff-match-patch's match_main.
+ *
+ * Exact matches at the location are taken as they are, exact matches
+ * nearby bound the score fuzzy matches have to beat. Patterns longer than
+ * a bitap word are searched with multi-word bit vectors.
+ *
+ * @return beginning of the match or iEnd if none scores under the threshold
+ */
+template<typename Iterator>
+Iterator match(Iterator iBegin, Iterator iEnd, Iterator iPatternBegin, Iterator iPatternEnd, Iterator iLocationIt,
+		const match_options& iOptions = match_options())
+{
+	const size_t aTextSize = iEnd - iBegin;
+	const size_t aPatternSize = iPatternEnd - iPatternBegin;
+	const std::ptrdiff_t anOffset = iLocationIt - iBegin;
+	const size_t aLocation = (anOffset > 0) ? std::min(static_cast<size_t>(anOffset), aTextSize) : 0;
+	if(detail::equal(iBegin, iEnd, iPatternBegin, iPatternEnd))
+	{
+		return iBegin;
+	}
+	if((aLocation + aPatternSize <= aTextSize) && std::equal(iPatternBegin, iPatternEnd, iBegin + aLocation))
+	{
+		return iBegin + aLocation;
+	}
+	if(aTextSize == 0)
+	{
+		return iEnd;
+	}
+
+	// Closest exact matches on both sides, within the distance at which
+	// they still score under the threshold
+	double aThreshold = iOptions._threshold;
+	const size_t aReach = detail::bitap_reach(0, aLocation, aPatternSize, aThreshold, aPatternSize + aTextSize, iOptions);
+	const Iterator aNextEnd = iBegin + std::min(aTextSize, aLocation + aReach + aPatternSize);
+	const Iterator aNextIt = detail::find_subrange(iBegin + aLocation, aNextEnd, iPatternBegin, iPatternEnd);
+	if(aNextIt != aNextEnd)
+	{
+		aThreshold = std::min(aThreshold,
+				detail::bitap_score(0, aNextIt - iBegin, aLocation, aPatternSize, iOptions));
+	}
+	const Iterator aPriorEnd = iBegin + std::min(aTextSize, aLocation + aPatternSize);
+	const Iterator aPriorBegin = iBegin + ((aLocation > aReach) ? aLocation - aReach : 0);
+	const Iterator aPriorIt = std::find_end(aPriorBegin, aPriorEnd, iPatternBegin, iPatternEnd);
+	if(aPriorIt != aPriorEnd)
+	{
+		aThreshold = std::min(aThreshold,
+				detail::bitap_score(0, aPriorIt - iBegin, aLocation, aPatternSize, iOptions));
+	}
+
+	const size_t aBest = (aPatternSize <= detail::kBitapWordBits) ?
+			detail::match_bitap(iBegin, iEnd, iPatternBegin, iPatternEnd, aLocation, aThreshold, iOptions,
+					detail::single_word()) :
+			detail::match_bitap(iBegin, iEnd, iPatternBegin, iPatternEnd, aLocation, aThreshold, iOptions,
+					detail::multi_word((aPatternSize + detail::kBitapWordBits - 1) / detail::kBitapWordBits));
+	return (aBest < aTextSize) ? iBegin + aBest : iEnd;
+}
+
+}  // namespace diff
+}  // namespace izi
+
+#endif /* IZI_DIFF_MATCH_H_ */
@@ -0,0 +1,423 @@
+#ifndef IZI_DIFF_MERGE_H_
+#define IZI_DIFF_MERGE_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <list>
+#include <utility>
+#include <vector>
+
+#include "algorithm.h"
+#include "calculation.h"
+#include "executor.h"
+#include "operation.h"
+#include "range_traits.h"
+#include "types.h"
+
+namespace izi {
+namespace diff {
+
+/*! Region both sides of a three-way merge changed differently.
+ *
+ * The merged range holds our side of the region at its offset.
+ */
+template<typename Iterator>
+struct merge_conflict
+{
+	merge_conflict(): _offset(0), _base(), _ours(), _theirs() {}
+
+	//! Offset of the region in the merged range.
+	size_t _offset;
+
+	range<Iterator> _base;
+	range<Iterator> _ours;
+	range<Iterator> _theirs;
+};
+
+namespace detail {
+
+//! Change of a side against the base, offsets in units of the diff.
+struct merge_change
+{
+	merge_change(size_t iBegin, size_t iSideBegin):
+		_begin(iBegin), _end(iBegin), _sideBegin(iSideBegin), _sideEnd(iSideBegin) {}
+
+	size_t _begin;
+	size_t _end;
+	size_t _sideBegin;
+	size_t _sideEnd;
+};
+
+//! Part of the base changed by one or both sides, offsets in units of the diffs.
+struct merge_region
+{
+	merge_region(): _begin(0), _end(0), _oursBegin(0), _oursEnd(0), _theirsBegin(0), _theirsEnd(0),
+		_ours(false), _theirs(false) {}
+
+	size_t _begin;
+	size_t _end;
+	size_t _oursBegin;
+	size_t _oursEnd;
+	size_t _theirsBegin;
+	size_t _theirsEnd;
+	//! Whether our or their side changed the region.
+	bool _ours;
+	bool _theirs;
+};
+
+//! Changes of the diff of the base and a side, edits between two equalities make one change.
+template<typename Result>
+void merge_changes(const Result& iDiff, std::vector<merge_change>& oChanges)
+{
+	size_t aPos1(0);
+	size_t aPos2(0);
+	bool aChanged(false);
+	for(typename Result::const_iterator aHunkIt = iDiff.begin(); aHunkIt != iDiff.end(); ++aHunkIt)
+	{
+		const size_t aSize = aHunkIt->second.size();
+		if(aHunkIt->first.isEqual())
+		{
+			aPos1 += aSize;
+			aPos2 += aSize;
+			aChanged = false;
+			continue;
+		}
+
+		if(!aChanged)
+		{
+			oChanges.push_back(merge_change(aPos1, aPos2));
+			aChanged = true;
+		}
+		if(aHunkIt->first.isRemove())
+		{
+			aPos1 += aSize;
+			oChanges.back()._end = aPos1;
+		}
+		else
+		{
+			aPos2 += aSize;
+			oChanges.back()._sideEnd = aPos2;
+		}
+	}
+}
+
+/*! Extends the region by the changes of one side starting in it and
+ *  returns the end of them.
+ *
+ * Changes touching the region join it, so edits of both sides next to each
+ * other are merged into one region.
+ */
+inline size_t merge_extend(const std::vector<merge_change>& iChanges, size_t iIndex, merge_region& ioRegion)
+{
+	for(; (iIndex < iChanges.size()) && (iChanges[iIndex]._begin <= ioRegion._end); ++iIndex)
+	{
+		ioRegion._end = std::max(ioRegion._end, iChanges[iIndex]._end);
+	}
+	return iIndex;
+}
+
+/*! Range of a side in the region, ioShift is the offset of the side to the
+ *  base after the last change.
+ */
+inline bool merge_side_range(const std::vector<merge_change>& iChanges, size_t iFirst, size_t iLast,
+		const merge_region& iRegion, std::ptrdiff_t& ioShift, size_t& oBegin, size_t& oEnd)
+{
+	if(iFirst == iLast)
+	{
+		oBegin = iRegion._begin + ioShift;
+		oEnd = iRegion._end + ioShift;
+		return false;
+	}
+	const merge_change& aFirst = iChanges[iFirst];
+	const merge_change& aLast = iChanges[iLast - 1];
+	oBegin = aFirst._sideBegin - (aFirst._begin - iRegion._begin);
+	oEnd = aLast._sideEnd + (iRegion._end - aLast._end);
+	ioShift = static_cast<std::ptrdiff_t>(aLast._sideEnd) - static_cast<std::ptrdiff_t>(aLast._end);
+	return true;
+}
+
+/*! Walks the changes of both sides in lockstep and groups the overlapping
+ *  ones into regions, linear in the number of changes.
+ */
+inline void merge_regions(const std::vector<merge_change>& iOurs, const std::vector<merge_change>& iTheirs,
+		std::vector<merge_region>& oRegions)
+{
+	size_t anOurs(0);
+	size_t aTheirs(0);
+	std::ptrdiff_t anOursShift(0);
+	std::ptrdiff_t aTheirsShift(0);
+	while((anOurs < iOurs.size()) || (aTheirs < iTheirs.size()))
+	{
+		const bool anOursFirst((aTheirs == iTheirs.size()) ||
+				((anOurs < iOurs.size()) && (iOurs[anOurs]._begin <= iTheirs[aTheirs]._begin)));
+		const merge_change& aFirst = anOursFirst ? iOurs[anOurs] : iTheirs[aTheirs];
+		merge_region aRegion;
+		aRegion._begin = aFirst._begin;
+		aRegion._end = aFirst._end;
+
+		const size_t anOursFirstIndex(anOurs);
+		const size_t aTheirsFirstIndex(aTheirs);
+		size_t aJoined(0);
+		do
+		{
+			aJoined = anOurs + aTheirs;
+			anOurs = merge_extend(iOurs, anOurs, aRegion);
+			aTheirs = merge_extend(iTheirs, aTheirs, aRegion);
+		}
+		while(aJoined != anOurs + aTheirs);
+
+		aRegion._ours = merge_side_range(iOurs, anOursFirstIndex, anOurs, aRegion, anOursShift,
+				aRegion._oursBegin, aRegion._oursEnd);
+		aRegion._theirs = merge_side_range(iTheirs, aTheirsFirstIndex, aTheirs, aRegion, aTheirsShift,
+				aRegion._theirsBegin, aRegion._theirsEnd);
+		oRegions.push_back(aRegion);
+	}
+}
+
+//! Iterators at element offsets of a range.
+template<typename Iterator>
+struct element_positions
+{
+	explicit element_positions(Iterator iBegin): _begin(iBegin) {}
+
+	Iterator operator[](size_t iOffset) const
+	{
+		return detail::next(_begin, iOffset);
+	}
+
+	Iterator _begin;
+};
+
+/*! Copies the base with the regions changed by the sides into the merged
+ *  range, positions map offsets of the diffs to iterators.
+ *
+ * @return true if no region conflicts
+ */
+template<typename Range, typename Positions, typename Conflicts>
+bool merge_assemble(const std::vector<merge_region>& iRegions, const Range& iBase, const Positions& iBasePositions,
+		const Positions& iOursPositions, const Positions& iTheirsPositions, Range& oMerged, Conflicts& oConflicts)
+{
+	typedef typename Conflicts::value_type conflict_type;
+
+	bool aClean(true);
+	typename Range::const_iterator aCopiedIt = iBase.begin();
+	for(std::vector<merge_region>::const_iterator aRegionIt = iRegions.begin(); aRegionIt != iRegions.end(); ++aRegionIt)
+	{
+		oMerged.insert(oMerged.end(), aCopiedIt, iBasePositions[aRegionIt->_begin]);
+		aCopiedIt = iBasePositions[aRegionIt->_end];
+
+		const typename Range::const_iterator anOursIt = iOursPositions[aRegionIt->_oursBegin];
+		const typename Range::const_iterator anOursEnd = iOursPositions[aRegionIt->_oursEnd];
+		const typename Range::const_iterator aTheirsIt = iTheirsPositions[aRegionIt->_theirsBegin];
+		const typename Range::const_iterator aTheirsEnd = iTheirsPositions[aRegionIt->_theirsEnd];
+		if(!aRegionIt->_ours)
+		{
+			oMerged.insert(oMerged.end(), aTheirsIt, aTheirsEnd);
+			continue;
+		}
+		if(aRegionIt->_theirs && !equal(anOursIt, anOursEnd, aTheirsIt, aTheirsEnd))
+		{
+			conflict_type aConflict;
+			aConflict._offset = oMerged.size();
+			aConflict._base = range<typename Range::const_iterator>(iBasePositions[aRegionIt->_begin], aCopiedIt);
+			aConflict._ours = range<typename Range::const_iterator>(anOursIt, anOursEnd);
+			aConflict._theirs = range<typename Range::const_iterator>(aTheirsIt, aTheirsEnd);
+			oConflicts.push_back(aConflict);
+			aClean = false;
+		}
+		oMerged.insert(oMerged.end(), anOursIt, anOursEnd);
+	}
+	oMerged.insert(oMerged.end(), aCopiedIt, iBase.end());
+	return aClean;
+}
+
+//! Side of an element merge, diffed against the base.
+template<typename Range>
+struct element_merge_side
+{
+	element_merge_side(): _range(0), _diff() {}
+
+	const Range* _range;
+	std::list<std::pair<operation, Range> > _diff;
+};
+
+template<typename Traits, typename Range>
+class element_merge_task
+{
+public:
+	element_merge_task(const Range& iBase, const options& iOptions): _base(&iBase), _options(&iOptions) {}
+
+	void operator()(element_merge_side<Range>& ioSide) const
+	{
+		calculate<Traits>(_base->begin(), _base->end(), ioSide._range->begin(), ioSide._range->end(),
+				ioSide._diff, *_options);
+	}
+
+private:
+	const Range* _base;
+	const options* _options;
+};
+
+/*! Splits the range into lines mapped to indices and keeps their beginnings,
+ *  the end of the range included.
+ *
+ * Lines of the shared map, if any, keep their index. Others are added to
+ * ioLines with indices following the shared ones, so the shared map is only
+ * read and several ranges can be transformed against it concurrently.
+ */
+template<typename Traits, typename Iterator, typename LineMap, typename LineVector, typename Positions>
+void merge_transform(Iterator iBegin, Iterator iEnd, const LineMap* iShared, LineMap& ioLines,
+		LineVector& oLines, Positions& oPositions)
+{
+	const line_index aFirst = iShared ? iShared->size() : 0;
+	while(iBegin != iEnd)
+	{
+		oPositions.push_back(iBegin);
+		Iterator aEndl = std::find(iBegin, iEnd, Traits::endl());
+		if(aEndl != iEnd)
+		{
+			++aEndl;
+		}
+		const range<Iterator> aLine(iBegin, aEndl);
+
+		typename LineMap::const_iterator aLineIt = iShared ? iShared->find(aLine) : ioLines.end();
+		if(!iShared || (aLineIt == iShared->end()))
+		{
+			aLineIt = ioLines.insert(std::make_pair(aLine, aFirst + ioLines.size())).first;
+		}
+		oLines.push_back(aLineIt->second);
+		iBegin = aEndl;
+	}
+	oPositions.push_back(iEnd);
+}
+
+//! Side of a line merge, its lines are diffed against the lines of the base.
+template<typename Iterator>
+struct line_merge_side
+{
+	line_merge_side(): _begin(), _end(), _lines(), _positions(), _diff() {}
+
+	Iterator _begin;
+	Iterator _end;
+	line_vector _lines;
+	std::vector<Iterator> _positions;
+	std::list<std::pair<operation, line_vector> > _diff;
+};
+
+template<typename Traits, typename Iterator>
+class line_merge_task
+{
+public:
+	typedef typename line_map<Iterator>::type line_map_type;
+
+	line_merge_task(const line_map_type& iBaseMap, const line_vector& iBaseLines, const options& iOptions):
+		_baseMap(&iBaseMap), _baseLines(&iBaseLines), _options(&iOptions) {}
+
+	void operator()(line_merge_side<Iterator>& ioSide) const
+	{
+		line_map_type aLines;
+		merge_transform<Traits>(ioSide._begin, ioSide._end, _baseMap, aLines, ioSide._lines, ioSide._positions);
+		const line_vector& aSideLines = ioSide._lines;
+		calculate<void_traits>(_baseLines->begin(), _baseLines->end(), aSideLines.begin(), aSideLines.end(),
+				ioSide._diff, *_options);
+	}
+
+private:
+	const line_map_type* _baseMap;
+	const line_vector* _baseLines;
+	const options* _options;
+};
+
+template<typename Traits, typename Range, typename Conflicts, typename Executor>
+bool merge3(const Range& iBase, const Range& iOurs, const Range& iTheirs, Range& oMerged, Conflicts& oConflicts,
+		const Executor& iExecutor, const options& iOptions, const non_line_range&)
+{
+	element_merge_side<Range> aSides[2];
+	aSides[0]._range = &iOurs;
+	aSides[1]._range = &iTheirs;
+	iExecutor.for_each(aSides, aSides + 2, element_merge_task<Traits, Range>(iBase, iOptions));
+
+	std::vector<merge_change> anOurs;
+	std::vector<merge_change> aTheirs;
+	std::vector<merge_region> aRegions;
+	merge_changes(aSides[0]._diff, anOurs);
+	merge_changes(aSides[1]._diff, aTheirs);
+	merge_regions(anOurs, aTheirs, aRegions);
+
+	typedef element_positions<typename Range::const_iterator> positions_type;
+	return merge_assemble(aRegions, iBase, positions_type(iBase.begin()), positions_type(iOurs.begin()),
+			positions_type(iTheirs.begin()), oMerged, oConflicts);
+}
+
+template<typename Traits, typename Range, typename Conflicts, typename Executor>
+bool merge3(const Range& iBase, const Range& iOurs, const Range& iTheirs, Range& oMerged, Conflicts& oConflicts,
+		const Executor& iExecutor, const options& iOptions, const line_range&)
+{
+	typedef typename Range::const_iterator iterator;
+	typedef typename line_merge_task<Traits, iterator>::line_map_type line_map_type;
+
+	line_map_type aBaseMap;
+	line_vector aBaseLines;
+	std::vector<iterator> aBasePositions;
+	merge_transform<Traits>(iBase.begin(), iBase.end(), static_cast<const line_map_type*>(0), aBaseMap,
+			aBaseLines, aBasePositions);
+
+	line_merge_side<iterator> aSides[2];
+	aSides[0]._begin = iOurs.begin();
+	aSides[0]._end = iOurs.end();
+	aSides[1]._begin = iTheirs.begin();
+	aSides[1]._end = iTheirs.end();
+	iExecutor.for_each(aSides, aSides + 2, line_merge_task<Traits, iterator>(aBaseMap, aBaseLines, iOptions));
+
+	std::vector<merge_change> anOurs;
+	std::vector<merge_change> aTheirs;
+	std::vector<merge_region> aRegions;
+	merge_changes(aSides[0]._diff, anOurs);
+	merge_changes(aSides[1]._diff, aTheirs);
+	merge_regions(anOurs, aTheirs, aRegions);
+	return merge_assemble(aRegions, iBase, aBasePositions, aSides[0]._positions, aSides[1]._positions,
+			oMerged, oConflicts);
+}
+
+}  // namespace detail
+
+/*! Three-way merge of the changes of two sides to their common base.
+ *
+ * The diffs of the base to both sides run as two tasks of the executor,
+ * e.g. concurrently with thread_executor. Their changes are then walked in
+ * lockstep, changes of both sides overlapping or touching each other form
+ * one region, which conflicts unless both sides changed it the same way.
+ *
+ * Ranges with line traits, e.g. strings, are merged by lines like diff3.
+ * The lines of the base are indexed once and shared by both tasks. Other
+ * ranges are merged element by element.
+ *
+ * @param oMerged range the merge is appended to, conflicting regions hold our side
+ * @param oConflicts container of merge_conflict<Range::const_iterator> the conflicts are appended to
+ * @return true if the merge has no conflicts
+ */
+template<typename Traits, typename Range, typename Conflicts, typename Executor>
+bool merge3(const Range& iBase, const Range& iOurs, const Range& iTheirs, Range& oMerged, Conflicts& oConflicts,
+		const Executor& iExecutor, const options& iOptions = options())
+{
+	return detail::merge3<Traits>(iBase, iOurs, iTheirs, oMerged, oConflicts, iExecutor, iOptions,
+			typename Traits::range_type());
+}
+
+template<typename Range, typename Conflicts, typename Executor>
+bool merge3(const Range& iBase, const Range& iOurs, const Range& iTheirs, Range& oMerged, Conflicts& oConflicts,
+		const Executor& iExecutor)
+{
+	return merge3<detail::range_traits<Range> >(iBase, iOurs, iTheirs, oMerged, oConflicts, iExecutor);
+}
+
+template<typename Range, typename Conflicts>
+bool merge3(const Range& iBase, const Range& iOurs, const Range& iTheirs, Range& oMerged, Conflicts& oConflicts)
+{
+	return merge3(iBase, iOurs, iTheirs, oMerged, oConflicts, sequential_executor());
+}
+
+}  // namespace diff
+}  // namespace izi
+
+#endif /* IZI_DIFF_MERGE_H_ */
@@ -62,8 +62,18 @@ public:
 		return _value;
 	}
 
+	bool operator==(const operation& iOperation) const
+	{
+		return _value == iOperation._value;
+	}
+
+	bool operator!=(const operation& iOperation) const
+	{
+		return _value != iOperation._value;
+	}
+
 private:
-	const detail::OPERATION _value;
+	detail::OPERATION _value;
 };
 
 }  // namespace diff
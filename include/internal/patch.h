@@ -0,0 +1,127 @@
+#ifndef IZI_DIFF_PATCH_H_
+#define IZI_DIFF_PATCH_H_
+
+#include <algorithm>
+#include <iterator>
+
+#include "algorithm.h"
+#include "types.h"
+
+namespace izi {
+namespace diff {
+
+//! Default number of equal elements kept around the edits of a patch.
+const size_t kDefaultPatchMargin = 4;
+
+/*! Edits of a diff close to each other with the equal elements around them.
+ *
+ * Patches refer to the hunks and elements of the diff they are made of,
+ * which has to outlive them unchanged.
+ *
+ * @param Iterator iterator over (operation, range) hunks
+ */
+template<typename Iterator>
+struct patch
+{
+	typedef Iterator hunk_iterator;
+	typedef typename std::iterator_traits<Iterator>::value_type::second_type::const_iterator element_iterator;
+	typedef range<element_iterator> view_type;
+
+	patch(): _start1(0), _start2(0), _length1(0), _length2(0), _prefix(), _begin(), _end(), _suffix() {}
+
+	//! Offset of the prefix in the first range.
+	size_t _start1;
+	//! Offset of the prefix in the second range.
+	size_t _start2;
+	//! Elements of the first range covered, including the context.
+	size_t _length1;
+	//! Elements of the second range covered, including the context.
+	size_t _length2;
+
+	//! Equal elements before the first edit.
+	view_type _prefix;
+	//! Hunks from the first to the last edit, equalities between them included.
+	Iterator _begin;
+	Iterator _end;
+	//! Equal elements after the last edit.
+	view_type _suffix;
+};
+
+/*! Coalesces the edits of the hunks into patches with iMargin equal
+ *  elements of context, see diff-match-patch's patch_make.
+ *
+ * Equalities up to twice the margin long stay inside a patch, longer ones
+ * end it. Single pass over the hunks, the context is viewed in place.
+ *
+ * @param oPatches container of patch<Iterator> the patches are appended to
+ */
+template<typename Iterator, typename Patches>
+void make_patches(Iterator iBegin, Iterator iEnd, Patches& oPatches, size_t iMargin = kDefaultPatchMargin)
+{
+	typedef patch<Iterator> patch_type;
+	typedef typename patch_type::view_type view_type;
+
+	patch_type aPatch;
+	bool anOpen(false);
+	view_type aPrefix;
+	size_t aPrefixSize(0);
+	size_t aCount1(0);
+	size_t aCount2(0);
+	for(Iterator aHunkIt = iBegin; aHunkIt != iEnd; ++aHunkIt)
+	{
+		const size_t aSize = aHunkIt->second.size();
+		if(aHunkIt->first.isEqual())
+		{
+			const Iterator aNextIt = detail::next(aHunkIt);
+			if(anOpen && ((aSize > 2 * iMargin) || (aNextIt == iEnd)))
+			{
+				// Long or last equality, the patch ends with its beginning
+				const size_t aContext = std::min(aSize, iMargin);
+				aPatch._end = aHunkIt;
+				aPatch._suffix = view_type(aHunkIt->second.begin(), detail::next(aHunkIt->second.begin(), aContext));
+				aPatch._length1 += aContext;
+				aPatch._length2 += aContext;
+				oPatches.push_back(aPatch);
+				anOpen = false;
+			}
+			else if(anOpen)
+			{
+				aPatch._length1 += aSize;
+				aPatch._length2 += aSize;
+			}
+			if(!anOpen)
+			{
+				aPrefixSize = std::min(aSize, iMargin);
+				aPrefix = view_type(detail::prior(aHunkIt->second.end(), aPrefixSize), aHunkIt->second.end());
+			}
+			aCount1 += aSize;
+			aCount2 += aSize;
+			continue;
+		}
+
+		if(!anOpen)
+		{
+			aPatch = patch_type();
+			aPatch._start1 = aCount1 - aPrefixSize;
+			aPatch._start2 = aCount2 - aPrefixSize;
+			aPatch._length1 = aPrefixSize;
+			aPatch._length2 = aPrefixSize;
+			aPatch._prefix = aPrefix;
+			aPatch._begin = aHunkIt;
+			anOpen = true;
+		}
+		(aHunkIt->first.isInsert() ? aCount2 : aCount1) += aSize;
+		(aHunkIt->first.isInsert() ? aPatch._length2 : aPatch._length1) += aSize;
+	}
+
+	if(anOpen)
+	{
+		aPatch._end = iEnd;
+		oPatches.push_back(aPatch);
+	}
+}
+
+}  // namespace diff
+}  // namespace izi
+
+#endif /* IZI_DIFF_PATCH_H_ */
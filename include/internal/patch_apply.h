@@ -0,0 +1,232 @@
+#ifndef IZI_DIFF_PATCH_APPLY_H_
+#define IZI_DIFF_PATCH_APPLY_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <list>
+#include <utility>
+#include <vector>
+
+#include "calculation.h"
+#include "match.h"
+#include "operation.h"
+#include "patch.h"
+#include "range_traits.h"
+#include "types.h"
+
+namespace izi {
+namespace diff {
+namespace detail {
+
+//! Replacement of the text between two offsets by the inserted elements.
+template<typename Iterator>
+struct patch_edit
+{
+	patch_edit(size_t iBegin, size_t iEnd, Iterator iInsertBegin, Iterator iInsertEnd):
+		_begin(iBegin), _end(iEnd), _insertBegin(iInsertBegin), _insertEnd(iInsertEnd) {}
+
+	size_t _begin;
+	size_t _end;
+	Iterator _insertBegin;
+	Iterator _insertEnd;
+};
+
+/*! Offset in the second range of the element at iIndex in the first one,
+ *  see diff-match-patch's diff_xIndex.
+ *
+ * Removed elements map to the beginning of their removal.
+ */
+template<typename Result>
+size_t x_index(const Result& iDiff, size_t iIndex)
+{
+	size_t aCount1(0);
+	size_t aCount2(0);
+	size_t aLast1(0);
+	size_t aLast2(0);
+	typename Result::const_iterator aHunkIt = iDiff.begin();
+	for(; aHunkIt != iDiff.end(); ++aHunkIt)
+	{
+		const size_t aSize = aHunkIt->second.size();
+		if(!aHunkIt->first.isInsert())
+		{
+			aCount1 += aSize;
+		}
+		if(!aHunkIt->first.isRemove())
+		{
+			aCount2 += aSize;
+		}
+		if(aCount1 > iIndex)
+		{
+			break;
+		}
+		aLast1 = aCount1;
+		aLast2 = aCount2;
+	}
+	if((aHunkIt != iDiff.end()) && aHunkIt->first.isRemove())
+	{
+		return aLast2;
+	}
+	return aLast2 + (iIndex - aLast1);
+}
+
+//! Levenshtein distance of the ranges of the diff.
+template<typename Result>
+size_t levenshtein(const Result& iDiff)
+{
+	size_t aDistance(0);
+	size_t anInserted(0);
+	size_t aRemoved(0);
+	for(typename Result::const_iterator aHunkIt = iDiff.begin(); aHunkIt != iDiff.end(); ++aHunkIt)
+	{
+		if(aHunkIt->first.isEqual())
+		{
+			aDistance += std::max(anInserted, aRemoved);
+			anInserted = 0;
+			aRemoved = 0;
+		}
+		else
+		{
+			(aHunkIt->first.isInsert() ? anInserted : aRemoved) += aHunkIt->second.size();
+		}
+	}
+	return aDistance + std::max(anInserted, aRemoved);
+}
+
+/*! Edits of the patch located at iOffset of the text.
+ *
+ * With a diff of the expected and the found context, offsets in the
+ * context are mapped to the found one, otherwise they are taken as they are.
+ */
+template<typename Patch, typename Result, typename Edits>
+void locate_edits(const Patch& iPatch, size_t iOffset, const Result* iDiff, Edits& oEdits)
+{
+	size_t anIndex = iPatch._prefix.size();
+	for(typename Patch::hunk_iterator aHunkIt = iPatch._begin; aHunkIt != iPatch._end; ++aHunkIt)
+	{
+		const size_t aSize = aHunkIt->second.size();
+		if(aHunkIt->first.isInsert())
+		{
+			const size_t aPos = iOffset + (iDiff ? x_index(*iDiff, anIndex) : anIndex);
+			oEdits.push_back(typename Edits::value_type(aPos, aPos, aHunkIt->second.begin(), aHunkIt->second.end()));
+			continue;
+		}
+		if(aHunkIt->first.isRemove())
+		{
+			const size_t aBegin = iOffset + (iDiff ? x_index(*iDiff, anIndex) : anIndex);
+			const size_t anEnd = iOffset + (iDiff ? x_index(*iDiff, anIndex + aSize) : anIndex + aSize);
+			oEdits.push_back(typename Edits::value_type(aBegin, anEnd, aHunkIt->second.end(), aHunkIt->second.end()));
+		}
+		anIndex += aSize;
+	}
+}
+
+}  // namespace detail
+
+/*! Applies the patches to the text, see diff-match-patch's patch_apply.
+ *
+ * Patches are located in order, each after the previous one, at their
+ * offset in the first range shifted by how far the previous patch was
+ * found from its own. Their context (prefix, equal and removed elements,
+ * suffix) is compared there first, then searched exactly and at last
+ * fuzzily by match(). Context found with differences is diffed at element
+ * level against the expected one to map the edits onto it, and rejected if
+ * their Levenshtein distance exceeds the match threshold.
+ *
+ * The text is only read, the edits of all patches located are collected
+ * and the new text is assembled in one pass of copies to its final size.
+ *
+ * @param oText text with the patches applied, e.g. std::string or std::vector
+ * @param oApplied whether each patch was applied
+ * @return true if all patches were applied
+ */
+template<typename Patches, typename Range>
+bool apply(const Patches& iPatches, const Range& iText, Range& oText, std::vector<bool>& oApplied,
+		const match_options& iOptions = match_options())
+{
+	typedef typename Patches::value_type patch_type;
+	typedef typename Range::const_iterator iterator;
+	typedef std::list<std::pair<operation, range<iterator> > > diff_type;
+	typedef std::vector<detail::patch_edit<typename patch_type::element_iterator> > edits_type;
+
+	const iterator aTextBegin = iText.begin();
+	const size_t aTextSize = iText.size();
+	oApplied.assign(iPatches.size(), false);
+
+	edits_type anEdits;
+	Range aContext;
+	diff_type aDiff;
+	bool anAllApplied(true);
+	size_t aCursor(0);
+	std::ptrdiff_t aShift(0);
+	size_t anIndex(0);
+	for(typename Patches::const_iterator aPatchIt = iPatches.begin(); aPatchIt != iPatches.end(); ++aPatchIt, ++anIndex)
+	{
+		aContext.clear();
+		aContext.insert(aContext.end(), aPatchIt->_prefix.begin(), aPatchIt->_prefix.end());
+		for(typename patch_type::hunk_iterator aHunkIt = aPatchIt->_begin; aHunkIt != aPatchIt->_end; ++aHunkIt)
+		{
+			if(!aHunkIt->first.isInsert())
+			{
+				aContext.insert(aContext.end(), aHunkIt->second.begin(), aHunkIt->second.end());
+			}
+		}
+		aContext.insert(aContext.end(), aPatchIt->_suffix.begin(), aPatchIt->_suffix.end());
+
+		const std::ptrdiff_t anExpected = static_cast<std::ptrdiff_t>(aPatchIt->_start1) + aShift;
+		const size_t aLocation = std::max(static_cast<size_t>(std::max(anExpected, std::ptrdiff_t(0))), aCursor);
+		const iterator aSearchBegin = aTextBegin + aCursor;
+		const iterator aFoundIt = match(aSearchBegin, iText.end(), iterator(aContext.begin()), iterator(aContext.end()),
+				aTextBegin + std::min(aLocation, aTextSize), iOptions);
+		if(aFoundIt == iText.end() && !(aContext.empty() && aLocation <= aTextSize))
+		{
+			anAllApplied = false;
+			continue;
+		}
+
+		const size_t anOffset = aFoundIt - aTextBegin;
+		const size_t aFoundSize = std::min(aContext.size(), aTextSize - anOffset);
+		const iterator aFoundEnd = aFoundIt + aFoundSize;
+		if(std::equal(aFoundIt, aFoundEnd, iterator(aContext.begin())) && (aFoundSize == aContext.size()))
+		{
+			detail::locate_edits(*aPatchIt, anOffset, static_cast<const diff_type*>(0), anEdits);
+		}
+		else
+		{
+			aDiff.clear();
+			detail::calculate_hunks<detail::void_traits>(iterator(aContext.begin()), iterator(aContext.end()),
+					aFoundIt, aFoundEnd, aDiff, options());
+			if(detail::levenshtein(aDiff) > iOptions._threshold * aContext.size())
+			{
+				anAllApplied = false;
+				continue;
+			}
+			detail::locate_edits(*aPatchIt, anOffset, &aDiff, anEdits);
+		}
+		oApplied[anIndex] = true;
+		aShift = static_cast<std::ptrdiff_t>(anOffset) - static_cast<std::ptrdiff_t>(aPatchIt->_start1);
+		aCursor = anOffset + aFoundSize;
+	}
+
+	size_t aSize = aTextSize;
+	for(typename edits_type::const_iterator anEditIt = anEdits.begin(); anEditIt != anEdits.end(); ++anEditIt)
+	{
+		aSize += std::distance(anEditIt->_insertBegin, anEditIt->_insertEnd) - (anEditIt->_end - anEditIt->_begin);
+	}
+
+	oText.resize(aSize);
+	typename Range::iterator anOutputIt = oText.begin();
+	size_t aCopied(0);
+	for(typename edits_type::const_iterator anEditIt = anEdits.begin(); anEditIt != anEdits.end(); ++anEditIt)
+	{
+		anOutputIt = std::copy(aTextBegin + aCopied, aTextBegin + anEditIt->_begin, anOutputIt);
+		anOutputIt = std::copy(anEditIt->_insertBegin, anEditIt->_insertEnd, anOutputIt);
+		aCopied = anEditIt->_end;
+	}
+	std::copy(aTextBegin + aCopied, iText.end(), anOutputIt);
+	return anAllApplied;
+}
+
+}  // namespace diff
+}  // namespace izi
+
+#endif /* IZI_DIFF_PATCH_APPLY_H_ */
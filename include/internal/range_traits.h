@@ -1,6 +1,7 @@
 #ifndef IZI_DIFF_RANGE_TRAITS_H_
 #define IZI_DIFF_RANGE_TRAITS_H_
 
+#include <cstddef>
 #include <string>
 
 namespace izi {
@@ -10,18 +11,77 @@ namespace detail {
 struct line_range {};
 struct non_line_range {};
 
+//! Classes of characters for the semantic cleanup.
+enum CHAR_CLASS
+{
+	ALPHANUMERIC = 0,
+	PUNCTUATION = 1,
+	WHITESPACE = 2,
+	LINE_BREAK = 3
+};
+
+namespace char_classes {
+
+const unsigned char A = ALPHANUMERIC;
+const unsigned char P = PUNCTUATION;
+const unsigned char S = WHITESPACE;
+const unsigned char L = LINE_BREAK;
+
+//! Classes of ASCII characters, independent of the locale.
+const unsigned char kAscii[128] =
+{
+	P, P, P, P, P, P, P, P, P, S, L, S, S, L, P, P,
+	P, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P,
+	S, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P,
+	A, A, A, A, A, A, A, A, A, A, P, P, P, P, P, P,
+	P, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,
+	A, A, A, A, A, A, A, A, A, A, A, P, P, P, P, P,
+	P, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,
+	A, A, A, A, A, A, A, A, A, A, A, P, P, P, P, P
+};
+
+}  // namespace char_classes
+
+/*! Class of a Unicode code point.
+ *
+ * Non ASCII code points are letters of other scripts unless they are one of
+ * the Unicode separators or common punctuation.
+ */
+inline CHAR_CLASS unicode_char_class(unsigned long iCodePoint)
+{
+	if(iCodePoint < 128)
+	{
+		return static_cast<CHAR_CLASS>(char_classes::kAscii[iCodePoint]);
+	}
+	if((iCodePoint == 0x85) || (iCodePoint == 0x2028) || (iCodePoint == 0x2029))
+	{
+		return LINE_BREAK;
+	}
+	if((iCodePoint == 0xA0) || (iCodePoint == 0x1680) || ((iCodePoint >= 0x2000) && (iCodePoint <= 0x200A)) ||
+			(iCodePoint == 0x202F) || (iCodePoint == 0x205F) || (iCodePoint == 0x3000))
+	{
+		return WHITESPACE;
+	}
+	if(((iCodePoint >= 0xA1) && (iCodePoint <= 0xBF)) || ((iCodePoint >= 0x2010) && (iCodePoint <= 0x2027)) ||
+			((iCodePoint >= 0x3001) && (iCodePoint <= 0x3003)))
+	{
+		return PUNCTUATION;
+	}
+	return ALPHANUMERIC;
+}
+
 template<typename Range>
 struct range_traits
 {
 	typedef non_line_range range_type;
 };
 
-template<>
-struct range_traits<std::string>
+template<typename CharTraits, typename Allocator>
+struct range_traits<std::basic_string<char, CharTraits, Allocator> >
 {
 	typedef line_range range_type;
 
-	static std::string::size_type min_size()
+	static size_t min_size()
 	{
 		return 1000;
 	}
@@ -30,14 +90,21 @@ struct range_traits<std::string>
 	{
 		return '\n';
 	}
+
+	//! Bytes outside ASCII are parts of multibyte letters.
+	static CHAR_CLASS char_class(char iValue)
+	{
+		const unsigned char aValue = static_cast<unsigned char>(iValue);
+		return (aValue < 128) ? static_cast<CHAR_CLASS>(char_classes::kAscii[aValue]) : ALPHANUMERIC;
+	}
 };
 
-template<>
-struct range_traits<std::wstring>
+template<typename CharTraits, typename Allocator>
+struct range_traits<std::basic_string<wchar_t, CharTraits, Allocator> >
 {
 	typedef line_range range_type;
 
-	static std::wstring::size_type min_size()
+	static size_t min_size()
 	{
 		return 1000;
 	}
@@ -46,10 +113,21 @@ struct range_traits<std::wstring>
 	{
 		return L'\n';
 	}
+
+	static CHAR_CLASS char_class(wchar_t iValue)
+	{
+		return unicode_char_class(static_cast<unsigned long>(iValue));
+	}
 };
 
 typedef range_traits<void> void_traits;
 
+//! Whether elements are single bytes, e.g. of binary data.
+template<typename T> struct byte_element { static const bool value = false; };
+template<> struct byte_element<char> { static const bool value = true; };
+template<> struct byte_element<signed char> { static const bool value = true; };
+template<> struct byte_element<unsigned char> { static const bool value = true; };
+
 }  // namespace detail
 }  // namespace diff
 }  // namespace izi
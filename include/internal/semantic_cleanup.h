@@ -1,295 +1,516 @@
 #ifndef IZI_SEMANTIC_CLEANUP_H_
 #define IZI_SEMANTIC_CLEANUP_H_
 
-#include <cctype>
-#include <stack>
+#include <algorithm>
+#include <iterator>
+#include <vector>
 
 #include "algorithm.h"
 #include "cleanup.h"
+#include "range_traits.h"
 
 namespace izi {
 namespace diff {
 namespace detail {
 
-template<typename Traits, typename Range>
-int semantic_score(const Range& iRange1, const Range& iRange2)
+//! Class of the last element of a view, blank lines rank above line breaks.
+const size_t kBlankLine = 4;
+
+/*! Scores of boundaries by the classes of the elements on both sides.
+ *
+ * Edges (6) are handled separately, then blank lines (5), line breaks (4),
+ * end of sentences (3), whitespace (2) and non-alphanumeric elements (1).
+ */
+const int kSemanticScores[5][5] =
+{
+	//  ALPHANUMERIC, PUNCTUATION, WHITESPACE, LINE_BREAK, blank line
+	{0, 1, 2, 4, 5},
+	{1, 1, 3, 4, 5},
+	{2, 2, 2, 4, 5},
+	{4, 4, 4, 4, 5},
+	{5, 5, 5, 5, 5}
+};
+
+/*! Scores the boundary between two adjacent views, higher is better.
+ *
+ * Only the last elements of the first view and the first elements of the
+ * second one are looked at. Elements are classified by Traits::char_class(),
+ * so the score does not depend on the locale.
+ */
+template<typename Traits, typename Iterator>
+int semantic_score(Iterator iBegin1, Iterator iEnd1, Iterator iBegin2, Iterator iEnd2)
 {
-	if (iRange1.empty() || iRange2.empty())
+	if ((iBegin1 == iEnd1) || (iBegin2 == iEnd2))
 	{
 		// Edges are the best.
 		return 6;
 	}
 
-	typedef typename Range::value_type value_type;
-
-	static const Range kDoubleEndl(Traits::endl(), 2);
-
-	// Each port of this function behaves slightly differently due to
-	// subtle differences in each language's definition of things like
-	// 'whitespace'.  Since this function's purpose is largely cosmetic,
-	// the choice has been made to use each language's native features
-	// rather than force total conformity.
-	const value_type aValue1 = iRange1.back();
-	const value_type aValue2 = iRange2.front();
-	const bool aNonAlphaNumeric1(std::isalnum(aValue1) == 0);
-	const bool aNonAlphaNumeric2(std::isalnum(aValue2) == 0);;
-	const bool aWhitespace1 = aNonAlphaNumeric1 && (std::isspace(aValue1) != 0);
-	const bool aWhitespace2 = aNonAlphaNumeric2 && (std::isspace(aValue2) != 0);
-	const bool aLineBreak1 = aWhitespace1 && (std::iscntrl(aValue1) != 0);
-	const bool aLineBreak2 = aWhitespace2 && (std::iscntrl(aValue2) != 0);
-	const bool aBlankLine1 = aLineBreak1 && ends_with(iRange1.begin(), iRange1.end(), kDoubleEndl.begin(), kDoubleEndl.end());
-	const bool aBlankLine2 = aLineBreak2 && starts_with(iRange2.begin(), iRange2.end(), kDoubleEndl.begin(), kDoubleEndl.end());
-
-	if (aBlankLine1 || aBlankLine2)
-	{
-		// Five points for blank lines.
-		return 5;
-	}
-	else if (aLineBreak1 || aLineBreak2)
-	{
-		// Four points for line breaks.
-		return 4;
-	}
-	else if (aNonAlphaNumeric1 && !aWhitespace1 && aWhitespace2)
-	{
-		// Three points for end of sentences.
-		return 3;
-	}
-	else if (aWhitespace1 || aWhitespace2)
+	const Iterator aLastIt = detail::prior(iEnd1);
+	const Iterator aSecondIt = detail::next(iBegin2);
+	size_t aClass1 = Traits::char_class(*aLastIt);
+	size_t aClass2 = Traits::char_class(*iBegin2);
+	if((aClass1 == LINE_BREAK) && (*aLastIt == Traits::endl()) && (aLastIt != iBegin1) && (*detail::prior(aLastIt) == Traits::endl()))
 	{
-		// Two points for whitespace.
-		return 2;
+		aClass1 = kBlankLine;
 	}
-	else if (aNonAlphaNumeric1 || aNonAlphaNumeric2)
+	if((aClass2 == LINE_BREAK) && (*iBegin2 == Traits::endl()) && (aSecondIt != iEnd2) && (*aSecondIt == Traits::endl()))
 	{
-		// One point for non-alphanumeric.
-		return 1;
+		aClass2 = kBlankLine;
 	}
-	return 0;
+	return kSemanticScores[aClass1][aClass2];
 }
 
-template<typename Traits, typename Result>
+/*! Eliminates equalities that are smaller or equal to the edits on both
+ *  sides of them.
+ *
+ * Single scan keeping the equalities seen so far on a stack with the sizes
+ * of the edits before them. An eliminated equality merges the edits around
+ * it, so only the previous equality on the stack is checked again. The
+ * result is normalised once at the end.
+ */
+template<typename Result>
 void cleanup_small_equalities(Result& ioResult)
 {
-	const size_t aResultSize = ioResult.size();
-	std::stack<typename Result::iterator> aEqualities;
+	typedef typename Result::iterator iterator;
+	typedef equality_entry<iterator> entry_type;
+	typedef typename rebind_allocator<typename Result::allocator_type, entry_type>::type entry_allocator;
 
-	size_t aPreInsertSize(0);
-	size_t aPreDeleteSize(0);
-	size_t aPostInsertSize(0);
-	size_t aPostDeleteSize(0);
+	std::vector<entry_type, entry_allocator> anEqualities((entry_allocator(ioResult.get_allocator())));
+	bool aChanged(false);
 
-	typename Result::iterator aResultIt = ioResult.begin();
-	while(aResultIt != ioResult.end())
+	// Sizes of the edits after the last equality
+	size_t anInsertSize(0);
+	size_t aRemoveSize(0);
+
+	const iterator aResultEnd = ioResult.end();
+	for(iterator aResultIt = ioResult.begin(); aResultIt != aResultEnd; ++aResultIt)
 	{
 		if(aResultIt->first.isEqual())
 		{
-			aEqualities.push(aResultIt);
-			aPreInsertSize = aPostInsertSize;
-			aPreDeleteSize = aPostInsertSize;
-			aPostInsertSize = 0;
-			aPostDeleteSize = 0;
+			anEqualities.push_back(entry_type(aResultIt, anInsertSize, aRemoveSize));
+			anInsertSize = 0;
+			aRemoveSize = 0;
+			continue;
 		}
-		else
-		{
-			if(aResultIt->first.isInsert())
-			{
-				aPostInsertSize += aResultIt->second.size();
-			}
-			else if(aResultIt->first.isRemove())
-			{
-				aPostDeleteSize += aResultIt->second.size();
-			}
 
-			// Eliminate an equality that is smaller or equal to the edits on both
-			// sides of it.
-			if(!aEqualities.empty() &&
-					(aEqualities.top()->second.size() <= std::max(aPreInsertSize, aPreDeleteSize)) &&
-					(aEqualities.top()->second.size() <= std::max(aPostInsertSize, aPostDeleteSize)))
+		(aResultIt->first.isInsert() ? anInsertSize : aRemoveSize) += aResultIt->second.size();
+		while(!anEqualities.empty())
+		{
+			const entry_type& anEqual = anEqualities.back();
+			const size_t anEqualSize = anEqual._it->second.size();
+			if((anEqualSize > std::max(anEqual._insertSize, anEqual._removeSize)) ||
+					(anEqualSize > std::max(anInsertSize, aRemoveSize)))
 			{
-				aResultIt = aEqualities.top();
-				aResultIt->first.isRemove();
-				ioResult.insert(aResultIt, std::make_pair(operation::insert(), aResultIt->second));
-
-				aEqualities.pop();
-				if(!aEqualities.empty())
-				{
-					aEqualities.pop();
-				}
-				if(aEqualities.empty())
-				{
-					aResultIt = ioResult.begin();
-				}
-				else
-				{
-					aResultIt = aEqualities.top();
-				}
-				aPreInsertSize = 0;
-				aPreDeleteSize = 0;
-				aPostInsertSize = 0;
-				aPostDeleteSize = 0;
+				break;
 			}
+			// Replace the equality by its removal and insertion
+			ioResult.insert(detail::next(anEqual._it), std::make_pair(operation::insert(), anEqual._it->second));
+			anEqual._it->first = operation::remove();
+			anInsertSize += anEqual._insertSize + anEqualSize;
+			aRemoveSize += anEqual._removeSize + anEqualSize;
+			anEqualities.pop_back();
+			aChanged = true;
 		}
-		++aResultIt;
 	}
 
 	// Normalize the diff.
-	if(aResultSize != ioResult.size())
+	if(aChanged)
 	{
 		cleanup(ioResult);
 	}
 }
 
-template<typename Result>
+/*! Slides the edit to the boundary with the best semantic_score if it is
+ *  surrounded by equalities.
+ *
+ * e.g: The c<ins>at c</ins>ame. -> The <ins>cat </ins>came.
+ *
+ * Equality, edit and equality are seen as one sequence in which the edit
+ * occupies an offset. Offsets the edit can slide over are found on the
+ * hunks, only the part they span is copied once into ioWindow and scored
+ * through views, and the hunks are rewritten for the best offset only.
+ * Equalities left empty are erased, the edit itself never is.
+ *
+ * @param ioErased set if an equality was erased, the edit then meets other
+ *        edits and the block needs to be normalised
+ * @return hunk after the edit
+ */
+template<typename Traits, typename Result>
+typename Result::iterator slide_isolated_change(Result& ioResult, typename Result::iterator iChangeIt,
+		typename Result::value_type::second_type& ioWindow, bool& ioErased)
+{
+	typedef typename Result::value_type::second_type range_type;
+	typedef typename range_type::const_iterator range_iterator;
+	typedef typename Result::iterator iterator;
+
+	const iterator aNextIt = detail::next(iChangeIt);
+	if(iChangeIt->first.isEqual() || (iChangeIt == ioResult.begin()) || (aNextIt == ioResult.end()) ||
+			!aNextIt->first.isEqual() || !detail::prior(iChangeIt)->first.isEqual())
+	{
+		return aNextIt;
+	}
+
+	const iterator aPrevIt = detail::prior(iChangeIt);
+	range_type& anEquality1 = aPrevIt->second;
+	range_type& aChange = iChangeIt->second;
+	range_type& anEquality2 = aNextIt->second;
+	const size_t aSize1 = anEquality1.size();
+	const size_t aChangeSize = aChange.size();
+	const size_t aSize2 = anEquality2.size();
+
+	// The edit can slide left over the common suffix of the first equality
+	// and itself, and right as long as the element entering it equals the
+	// one leaving it.
+	const size_t aLeft = std::distance(
+			common_suffix(anEquality1.begin(), anEquality1.end(), aChange.begin(), aChange.end()), anEquality1.end());
+	size_t aRight = std::distance(aChange.begin(),
+			common_prefix(aChange.begin(), aChange.end(), anEquality2.begin(), anEquality2.end()));
+	if(aRight == aChangeSize)
+	{
+		const range_iterator aShiftedIt = detail::next(anEquality2.begin(), aChangeSize);
+		aRight += std::distance(aShiftedIt,
+				common_prefix(aShiftedIt, range_iterator(anEquality2.end()), range_iterator(anEquality2.begin()), range_iterator(anEquality2.end())));
+	}
+	if((aLeft == 0) && (aRight == 0))
+	{
+		return aNextIt;
+	}
+
+	// Window of the sequence covering all offsets with two elements of
+	// context on both sides, views reaching its ends are the real edges.
+	const size_t aFirst = aSize1 - aLeft;
+	const size_t aWindowBegin = (aFirst > 2) ? aFirst - 2 : 0;
+	const size_t aWindowEnd = aSize1 + aChangeSize + std::min(aSize2, aRight + 2);
+	ioWindow.assign(detail::next(anEquality1.begin(), aWindowBegin), anEquality1.end());
+	ioWindow.insert(ioWindow.end(), aChange.begin(), aChange.end());
+	ioWindow.insert(ioWindow.end(), anEquality2.begin(), detail::next(anEquality2.begin(), aWindowEnd - aSize1 - aChangeSize));
+
+	const range_iterator aBegin = ioWindow.begin();
+	const range_iterator anEnd = ioWindow.end();
+	size_t aBest = aFirst;
+	int aBestScore(-1);
+	for(size_t aPos = aFirst; aPos <= aSize1 + aRight; ++aPos)
+	{
+		const range_iterator aChangeBegin = detail::next(aBegin, aPos - aWindowBegin);
+		const range_iterator aChangeEnd = detail::next(aChangeBegin, aChangeSize);
+		const int aScore = semantic_score<Traits>(aBegin, aChangeBegin, aChangeBegin, aChangeEnd) +
+				semantic_score<Traits>(aChangeBegin, aChangeEnd, aChangeEnd, anEnd);
+		// The >= encourages trailing rather than leading whitespace on edits.
+		if(aScore >= aBestScore)
+		{
+			aBestScore = aScore;
+			aBest = aPos;
+		}
+	}
+
+	if(aBest == aSize1)
+	{
+		return aNextIt;
+	}
+
+	// We have an improvement, save it back to the diff.
+	const range_iterator aChangeBegin = detail::next(aBegin, aBest - aWindowBegin);
+	const range_iterator aChangeEnd = detail::next(aChangeBegin, aChangeSize);
+	if(aBest < aSize1)
+	{
+		anEquality2.insert(anEquality2.begin(), aChangeEnd, detail::next(aBegin, aSize1 + aChangeSize - aWindowBegin));
+		anEquality1.erase(detail::next(anEquality1.begin(), aBest), anEquality1.end());
+	}
+	else
+	{
+		anEquality1.insert(anEquality1.end(), detail::next(aBegin, aSize1 - aWindowBegin), aChangeBegin);
+		anEquality2.erase(anEquality2.begin(), detail::next(anEquality2.begin(), aBest - aSize1));
+	}
+	aChange.assign(aChangeBegin, aChangeEnd);
+
+	if(anEquality1.empty())
+	{
+		ioResult.erase(aPrevIt);
+		ioErased = true;
+	}
+	if(anEquality2.empty())
+	{
+		ioResult.erase(aNextIt);
+		ioErased = true;
+	}
+	return detail::next(iChangeIt);
+}
+
+//! Slides all single edits surrounded by equalities, see slide_isolated_change().
+template<typename Traits, typename Result>
 void cleanup_isolated_changes(Result& ioResult)
+{
+	typename Result::value_type::second_type aWindow(ioResult.get_allocator());
+	bool anErased(false);
+	typename Result::iterator aResultIt = ioResult.begin();
+	while(aResultIt != ioResult.end())
+	{
+		aResultIt = slide_isolated_change<Traits>(ioResult, aResultIt, aWindow, anErased);
+	}
+
+	if(anErased)
+	{
+		cleanup_first_pass(ioResult);
+	}
+}
+
+/*! Extracts overlaps between removals and the insertions following them.
+ *
+ * e.g: <del>abcxxx</del><ins>xxxdef</ins>
+ *   -> <del>abc</del>xxx<ins>def</ins>
+ * e.g: <del>xxxabc</del><ins>defxxx</ins>
+ *   -> <ins>def</ins>xxx<del>abc</del>
+ *
+ * Only extract an overlap if it is at least half as big as one of the edits.
+ * Hunks are added to oStats once they are final, the pass being the last one
+ * of the semantic cleanup.
+ */
+template<typename Result>
+void cleanup_change_overlaps(Result& ioResult, stats& oStats)
 {
 	typedef typename Result::value_type::second_type range_type;
+	typedef typename Result::iterator iterator;
 
-	if(ioResult.size() < 3)
+	oStats = stats();
+	if(ioResult.empty())
 	{
 		return;
 	}
-	typename Result::iterator aPrevIt = ioResult.begin();
-	typename Result::iterator aResultIt = next(aPrevIt);
-	typename Result::iterator aNextIt = next(aResultIt);
-	while(aNextIt != ioResult.end())
+	iterator aPrevIt = ioResult.begin();
+	iterator aResultIt = detail::next(aPrevIt);
+	for(; aResultIt != ioResult.end(); aPrevIt = aResultIt++)
 	{
-		if(aPrevIt->first.isEqual() && aNextIt->first.isEqual())
+		if(!aPrevIt->first.isRemove() || !aResultIt->first.isInsert())
 		{
-			// ABCDEF<ins>WTFDEF</ins>GHIJK
-			// commonString -> DEF
-			// eq1 = ABC
-			// change = WTF
-			// eq2 = WTFGHIJK
-			range_type anEquality1 = aPrevIt->second;
-			range_type aChange = aResultIt->second;
-			range_type anEquality2 = aNextIt->second;
-			typename range_type::iterator aSfxIt = common_suffix(anEquality1.begin(), anEquality1.end(), aChange.begin(), aChange.end());
-			if(aSfxIt != anEquality1.end())
-			{
-				const range_type aCommonStr(aSfxIt, anEquality1.end());
-				anEquality1.erase(aSfxIt, anEquality1.end());
-				aChange.resize(aChange.size() - aCommonStr.size());
-				aChange = aCommonStr+aChange;
-				anEquality2 = aCommonStr + anEquality2;
-			}
+			oStats.add(aPrevIt->first, aPrevIt->second.size());
+			continue;
+		}
 
-			// Second, step character by character right, looking for the best fit.
-			range_type aBestEquality1 = anEquality1;
-			range_type aBestChange = aChange;
-			range_type aBestEquality2 = anEquality2;
-			int aBestScore = semantic_score(anEquality1, aChange) + semantic_score(aChange, anEquality2);
-			while (!aChange.empty() && !anEquality2.empty() && aChange[0] == anEquality2[0])
-			{
-				anEquality1 += aChange[0];
-				aChange = aChange.substr(1) + anEquality2[0];
-				anEquality2 = anEquality2.substr(1);
-				int aScore = semantic_score(anEquality1, aChange) + semantic_score(aChange, anEquality2);
-				// The >= encourages trailing rather than leading whitespace on edits.
-				if (aScore >= aBestScore)
-				{
-					aBestScore = aScore;
-					aBestEquality1 = anEquality1;
-					aBestChange = aChange;
-					aBestEquality2 = anEquality2;
-				}
-			}
+		range_type& aDeletion = aPrevIt->second;
+		range_type& anInsertion = aResultIt->second;
+		const size_t aSize1 = common_overlap(aDeletion.begin(), aDeletion.end(), anInsertion.begin(), anInsertion.end());
+		const size_t aSize2 = common_overlap(anInsertion.begin(), anInsertion.end(), aDeletion.begin(), aDeletion.end());
+		const size_t aSize = std::max(aSize1, aSize2);
+		if((aSize == 0) || ((2 * aSize < aDeletion.size()) && (2 * aSize < anInsertion.size())))
+		{
+			oStats.add(aPrevIt->first, aDeletion.size());
+			continue;
+		}
 
-			if (aPrevIt->second != aBestEquality1)
-			{
-				// We have an improvement, save it back to the diff.
-				if (!aBestEquality1.empty())
-				{
-					aPrevIt->second = aBestEquality1;
-				}
-				else
-				{
-					ioResult.erase(aPrevIt);
-				}
-				aResultIt->second = aBestChange;
-
-				if (!aBestEquality2.empty())
-				{
-					aNextIt->second = aBestEquality2;
-				}
-				else
-				{
-					ioResult.erase(aNextIt);
-					aResultIt = aPrevIt;
-				}
-			}
+		range_type anOverlap(ioResult.get_allocator());
+		if(aSize1 >= aSize2)
+		{
+			anOverlap.assign(anInsertion.begin(), detail::next(anInsertion.begin(), aSize));
+			aDeletion.erase(detail::prior(aDeletion.end(), aSize), aDeletion.end());
+			anInsertion.erase(anInsertion.begin(), detail::next(anInsertion.begin(), aSize));
+		}
+		else
+		{
+			// Reverse overlap, swap and trim the surrounding edits.
+			anOverlap.assign(aDeletion.begin(), detail::next(aDeletion.begin(), aSize));
+			aDeletion.erase(aDeletion.begin(), detail::next(aDeletion.begin(), aSize));
+			anInsertion.erase(detail::prior(anInsertion.end(), aSize), anInsertion.end());
+			aDeletion.swap(anInsertion);
+			aPrevIt->first = operation::insert();
+			aResultIt->first = operation::remove();
 		}
-		aPrevIt = aResultIt;
-		++aResultIt;
-		aNextIt = (aResultIt != ioResult.end()) ? next(aResultIt) : aResultIt;
+		oStats.add(aPrevIt->first, aDeletion.size());
+		oStats.add(operation::equal(), anOverlap.size());
+		insert_swapped(ioResult, aResultIt, operation::equal(), anOverlap);
 	}
+	oStats.add(aPrevIt->first, aPrevIt->second.size());
 }
 
 template<typename Result>
 void cleanup_change_overlaps(Result& ioResult)
 {
-	typedef typename Result::value_type::second_type range_type;
+	stats aStats;
+	cleanup_change_overlaps(ioResult, aStats);
+}
 
-	// Find any overlaps between deletions and insertions.
-	// e.g: <del>abcxxx</del><ins>xxxdef</ins>
-	//   -> <del>abc</del>xxx<ins>def</ins>
-	// e.g: <del>xxxabc</del><ins>defxxx</ins>
-	//   -> <ins>def</ins>xxx<del>abc</del>
-	// Only extract an overlap if it is as big as the edit ahead or behind it.
-	if(ioResult.size() < 2)
+//! Semantic cleanup, oStats receives the statistics of the cleaned hunks.
+template<typename Traits, typename Result>
+void semantic_cleanup(Result& ioResult, stats& oStats)
+{
+	cleanup_small_equalities(ioResult);
+	cleanup_isolated_changes<Traits>(ioResult);
+	cleanup_change_overlaps(ioResult, oStats);
+}
+
+template<typename Traits, typename Result>
+void semantic_cleanup(Result& ioResult)
+{
+	stats aStats;
+	semantic_cleanup<Traits>(ioResult, aStats);
+}
+
+//! Default length from which equalities split the hunks into segments.
+const size_t kDefaultSplitSize = 64;
+
+//! Semantic cleanup of a single segment and its statistics, run by the executor.
+template<typename Traits>
+struct semantic_cleanup_task
+{
+	template<typename Segment>
+	void operator()(Segment& ioSegment) const
+	{
+		semantic_cleanup<Traits>(ioSegment.first, ioSegment.second);
+	}
+};
+
+/*! First and last edits of a segment, the ones next to its boundaries.
+ *
+ * Segments start and end with at most one equality after the cleanup.
+ */
+template<typename Result, typename Iterators>
+void boundary_changes(Result& ioSegment, Iterators& oChanges)
+{
+	typedef typename Result::iterator iterator;
+
+	iterator aFirstIt = ioSegment.begin();
+	if((aFirstIt != ioSegment.end()) && aFirstIt->first.isEqual())
+	{
+		++aFirstIt;
+	}
+	if(aFirstIt == ioSegment.end())
 	{
 		return;
 	}
-	typename Result::iterator aPrevIt = ioResult.begin();
-	typename Result::iterator aResultIt = next(aPrevIt);
-	while(aResultIt != ioResult.end())
+	iterator aLastIt = detail::prior(ioSegment.end());
+	if(aLastIt->first.isEqual())
+	{
+		--aLastIt;
+	}
+	oChanges.push_back(aFirstIt);
+	if(aLastIt != aFirstIt)
+	{
+		oChanges.push_back(aLastIt);
+	}
+}
+
+/*! Semantic cleanup of the segments between long equalities through the
+ *  executor.
+ *
+ * The passes only look at neighbouring hunks, so the hunks between
+ * equalities at least iSplitSize long are spliced into segments cleaned
+ * independently. Long equalities stay in place and are never eliminated.
+ * Once the segments are spliced back, equalities meeting at the boundaries
+ * are merged and the edits next to them are slid again, without walking the
+ * other hunks. Only if that slides an edit over a whole equality the hunks
+ * are normalised again. Edits at the boundaries may end up slightly
+ * differently than with a single pass.
+ *
+ * The statistics of the segments are summed with the long equalities into
+ * oStats and only the merged boundaries are counted again.
+ *
+ * Segments are cleaned with copies of the result's allocator, so with a
+ * concurrent executor it must be thread safe.
+ */
+template<typename Traits, typename Result, typename Executor>
+void semantic_cleanup(Result& ioResult, const Executor& iExecutor, size_t iSplitSize, stats& oStats)
+{
+	typedef typename Result::iterator iterator;
+	typedef std::pair<Result, stats> segment_type;
+	typedef typename rebind_allocator<typename Result::allocator_type, segment_type>::type segment_allocator;
+	typedef typename rebind_allocator<typename Result::allocator_type, iterator>::type iterator_allocator;
+	typedef std::vector<iterator, iterator_allocator> iterators;
+
+	// Hunks after the segments, the end for the last one
+	const iterator aResultEnd = ioResult.end();
+	iterators aSplits(iterator_allocator(ioResult.get_allocator()));
+	for(iterator aResultIt = ioResult.begin(); aResultIt != aResultEnd; ++aResultIt)
 	{
-		if(aPrevIt->first.isRemove() && aResultIt->first.isInsert())
+		if(aResultIt->first.isEqual() && (aResultIt->second.size() >= iSplitSize))
 		{
-			range_type& aDeletion = aPrevIt->second;
-			range_type& anInsertion = aResultIt->second;
-			typename range_type::iterator aSfxIt1 = common_suffix(aDeletion.begin(), aDeletion.end(), anInsertion.rbegin(), anInsertion.rend());
-			typename range_type::iterator aSfxIt2 = common_suffix(anInsertion.begin(), anInsertion.end(), aDeletion.rbegin(), aDeletion.rend());
-			const size_t aSize1(std::distance(aSfxIt1, aDeletion.end()));
-			const size_t aSize2(std::distance(aSfxIt2, anInsertion.end()));
-			if(aSize1 >= aSize2)
-			{
-				if((aSize1 >= (aDeletion.size() / 2.0)) || (aSize1 >= (anInsertion.size() / 2.0)))
-				{
-					ioResult.insert(aResultIt, std::make_pair(operation::equal(), range_type(aSfxIt1, aDeletion.end())));
-					aDeletion.resize(aSize1);
-					anInsertion = anInsertion.substr(aSize1);
-				}
-			}
-			else
+			aSplits.push_back(aResultIt);
+		}
+	}
+	aSplits.push_back(aResultEnd);
+
+	std::vector<segment_type, segment_allocator> aSegments(aSplits.size(),
+			segment_type(Result(ioResult.get_allocator()), stats()), segment_allocator(ioResult.get_allocator()));
+	iterator aBeginIt = ioResult.begin();
+	for(size_t anIndex = 0; anIndex < aSplits.size(); ++anIndex)
+	{
+		aSegments[anIndex].first.splice(aSegments[anIndex].first.end(), ioResult, aBeginIt, aSplits[anIndex]);
+		aBeginIt = (aSplits[anIndex] != aResultEnd) ? detail::next(aSplits[anIndex]) : aResultEnd;
+	}
+
+	iExecutor.for_each(aSegments.begin(), aSegments.end(), semantic_cleanup_task<Traits>());
+
+	iterators aChanges(iterator_allocator(ioResult.get_allocator()));
+	oStats = stats();
+	for(size_t anIndex = 0; anIndex < aSplits.size(); ++anIndex)
+	{
+		boundary_changes(aSegments[anIndex].first, aChanges);
+		ioResult.splice(aSplits[anIndex], aSegments[anIndex].first);
+		// Blocks end at the long equalities, so the statistics simply add up
+		oStats += aSegments[anIndex].second;
+		if(aSplits[anIndex] != aResultEnd)
+		{
+			oStats.add(operation::equal(), aSplits[anIndex]->second.size());
+		}
+	}
+
+	// Segments are normalised, only the equalities at their ends are merged
+	// with the long equalities between them
+	for(size_t anIndex = 0; anIndex + 1 < aSplits.size(); ++anIndex)
+	{
+		iterator anEqualIt = aSplits[anIndex];
+		iterator aMergedIt = ((anEqualIt != ioResult.begin()) && detail::prior(anEqualIt)->first.isEqual()) ?
+				detail::prior(anEqualIt) : anEqualIt;
+		iterator aMergedEnd = detail::next(anEqualIt);
+		if((aMergedEnd != aResultEnd) && aMergedEnd->first.isEqual())
+		{
+			++aMergedEnd;
+		}
+		oStats -= hunk_stats(aMergedIt, aMergedEnd);
+
+		if((anEqualIt != ioResult.begin()) && detail::prior(anEqualIt)->first.isEqual())
+		{
+			const iterator aPrevIt = detail::prior(anEqualIt);
+			aPrevIt->second.insert(aPrevIt->second.end(), anEqualIt->second.begin(), anEqualIt->second.end());
+			ioResult.erase(anEqualIt);
+			anEqualIt = aPrevIt;
+		}
+		const iterator aNextIt = detail::next(anEqualIt);
+		if((aNextIt != aResultEnd) && aNextIt->first.isEqual())
+		{
+			anEqualIt->second.insert(anEqualIt->second.end(), aNextIt->second.begin(), aNextIt->second.end());
+			if(aNextIt == aSplits[anIndex + 1])
 			{
-				if((aSize2 >= (aDeletion.size() / 2.0)) || (aSize2 >= (anInsertion.size() / 2.0)))
-				{
-					// Reverse overlap found.
-					// Insert an equality and swap and trim the surrounding edits.
-					ioResult.insert(aResultIt, std::make_pair(operation::equal(), range_type(aSfxIt2, anInsertion.end())));
-					anInsertion.resize(aSize2);
-					aDeletion = aDeletion.substr(aSize2);
-					anInsertion.swap(aDeletion);
-					aPrevIt->first = operation::insert();
-					aResultIt->first = operation::remove();
-				}
+				// Empty segment, the next long equality is merged already
+				aSplits[anIndex + 1] = anEqualIt;
 			}
+			ioResult.erase(aNextIt);
 		}
-		aPrevIt = aResultIt;
-		++aResultIt;
+		oStats += hunk_stats(anEqualIt, aMergedEnd);
+	}
+
+	// Slides only move elements between equalities, the statistics change
+	// when one of them is erased
+	typename Result::value_type::second_type aWindow(ioResult.get_allocator());
+	bool anErased(false);
+	for(typename iterators::const_iterator aChangeIt = aChanges.begin(); aChangeIt != aChanges.end(); ++aChangeIt)
+	{
+		slide_isolated_change<Traits>(ioResult, *aChangeIt, aWindow, anErased);
+	}
+
+	if(anErased)
+	{
+		cleanup_first_pass(ioResult);
+		cleanup_change_overlaps(ioResult, oStats);
 	}
 }
 
-template<typename Result>
-void semantic_cleanup(Result& ioResult)
+template<typename Traits, typename Result, typename Executor>
+void semantic_cleanup(Result& ioResult, const Executor& iExecutor, size_t iSplitSize = kDefaultSplitSize)
 {
-	cleanup_small_equalities(ioResult);
-	cleanup_isolated_changes(ioResult);
-	cleanup_change_overlaps(ioResult);
+	stats aStats;
+	semantic_cleanup<Traits>(ioResult, iExecutor, iSplitSize, aStats);
 }
 
-
 }  // namespace detail
 }  // namespace diff
 }  // namespace izi
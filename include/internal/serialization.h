@@ -0,0 +1,438 @@
+#ifndef IZI_DIFF_SERIALIZATION_H_
+#define IZI_DIFF_SERIALIZATION_H_
+
+#include <cstddef>
+#include <iterator>
+
+#include "operation.h"
+
+namespace izi {
+namespace diff {
+
+/* Binary format of an edit script
+ *
+ * The script is a sequence of hunks, each one starts with a single opcode
+ * byte (value of detail::OPERATION) followed by the hunk length encoded as
+ * a varint (7 bits per byte, least significant group first, high bit set on
+ * all but the last byte). Equalities and removals carry no payload, they
+ * are resolved against the base range. Insertions are followed by the
+ * inserted elements: raw bytes for single byte element types, one varint
+ * per element otherwise.
+ */
+
+namespace detail {
+
+template<typename OutputIterator>
+OutputIterator write_varint(size_t iValue, OutputIterator oOutput)
+{
+	while(iValue >= 0x80)
+	{
+		*oOutput = static_cast<char>((iValue & 0x7F) | 0x80);
+		++oOutput;
+		iValue >>= 7;
+	}
+	*oOutput = static_cast<char>(iValue);
+	++oOutput;
+	return oOutput;
+}
+
+template<typename InputIterator>
+bool read_varint(InputIterator& ioBegin, InputIterator iEnd, size_t& oValue)
+{
+	oValue = 0;
+	for(unsigned aShift = 0; (ioBegin != iEnd) && (aShift < sizeof(size_t) * 8); aShift += 7)
+	{
+		const unsigned char aByte = static_cast<unsigned char>(*ioBegin);
+		++ioBegin;
+		oValue |= static_cast<size_t>(aByte & 0x7F) << aShift;
+		if((aByte & 0x80) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+//! Encoding of inserted elements, varint per element.
+template<typename Element, bool Byte = (sizeof(Element) == 1)>
+struct element_codec
+{
+	template<typename OutputIterator>
+	static OutputIterator write(Element iElement, OutputIterator oOutput)
+	{
+		return write_varint(static_cast<size_t>(iElement), oOutput);
+	}
+
+	template<typename InputIterator>
+	static bool skip(InputIterator& ioBegin, InputIterator iEnd, size_t iCount)
+	{
+		size_t aValue;
+		for(; iCount > 0; --iCount)
+		{
+			if(!read_varint(ioBegin, iEnd, aValue))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	template<typename InputIterator, typename Range>
+	static void append(InputIterator iBegin, InputIterator iEnd, Range& oRange)
+	{
+		size_t aValue;
+		while(read_varint(iBegin, iEnd, aValue))
+		{
+			oRange.push_back(static_cast<Element>(aValue));
+		}
+	}
+};
+
+//! Encoding of inserted elements, raw bytes.
+template<typename Element>
+struct element_codec<Element, true>
+{
+	template<typename OutputIterator>
+	static OutputIterator write(Element iElement, OutputIterator oOutput)
+	{
+		*oOutput = static_cast<char>(iElement);
+		++oOutput;
+		return oOutput;
+	}
+
+	template<typename InputIterator>
+	static bool skip(InputIterator& ioBegin, InputIterator iEnd, size_t iCount)
+	{
+		for(; iCount > 0; --iCount, ++ioBegin)
+		{
+			if(ioBegin == iEnd)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	template<typename InputIterator, typename Range>
+	static void append(InputIterator iBegin, InputIterator iEnd, Range& oRange)
+	{
+		oRange.insert(oRange.end(), iBegin, iEnd);
+	}
+};
+
+//! Output iterator only counting written bytes.
+class counting_iterator
+{
+public:
+	typedef std::output_iterator_tag iterator_category;
+	typedef void value_type;
+	typedef void difference_type;
+	typedef void pointer;
+	typedef void reference;
+
+	counting_iterator(): _count(0) {}
+
+	counting_iterator& operator*()
+	{
+		return *this;
+	}
+
+	counting_iterator& operator=(char)
+	{
+		++_count;
+		return *this;
+	}
+
+	counting_iterator& operator++()
+	{
+		return *this;
+	}
+
+	counting_iterator operator++(int)
+	{
+		return *this;
+	}
+
+	size_t count() const
+	{
+		return _count;
+	}
+
+private:
+	size_t _count;
+};
+
+/*! Parses the encoded script and reports hunks to the handler.
+ *
+ * Equalities and removals are reported with their position in the base,
+ * insertions with their payload. Fails on malformed input or when the
+ * script does not cover exactly the whole base.
+ */
+template<typename Element, typename InputIterator, typename Handler>
+bool parse(InputIterator iBegin, InputIterator iEnd, size_t iBaseSize, Handler& ioHandler)
+{
+	size_t aPos(0);
+	while(iBegin != iEnd)
+	{
+		const unsigned char anOpcode = static_cast<unsigned char>(*iBegin);
+		++iBegin;
+		size_t aLength;
+		if(!read_varint(iBegin, iEnd, aLength))
+		{
+			return false;
+		}
+		if(anOpcode == INSERT)
+		{
+			InputIterator aPayloadIt = iBegin;
+			if(!element_codec<Element>::skip(iBegin, iEnd, aLength))
+			{
+				return false;
+			}
+			ioHandler.on_insert(aPayloadIt, iBegin, aLength);
+		}
+		else if((anOpcode == EQUAL) || (anOpcode == REMOVE))
+		{
+			if(aLength > iBaseSize - aPos)
+			{
+				return false;
+			}
+			if(anOpcode == EQUAL)
+			{
+				ioHandler.on_equal(aPos, aLength);
+			}
+			else
+			{
+				ioHandler.on_remove(aPos, aLength);
+			}
+			aPos += aLength;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return aPos == iBaseSize;
+}
+
+class size_handler
+{
+public:
+	size_handler(): _size(0) {}
+
+	void on_equal(size_t, size_t iLength)
+	{
+		_size += iLength;
+	}
+
+	void on_remove(size_t, size_t)
+	{
+	}
+
+	template<typename InputIterator>
+	void on_insert(InputIterator, InputIterator, size_t iLength)
+	{
+		_size += iLength;
+	}
+
+	size_t size() const
+	{
+		return _size;
+	}
+
+private:
+	size_t _size;
+};
+
+template<typename Range>
+class target_handler
+{
+public:
+	target_handler(const Range& iBase, Range& oTarget): _base(iBase), _target(oTarget) {}
+
+	void on_equal(size_t iPos, size_t iLength)
+	{
+		_target.insert(_target.end(), _base.begin() + iPos, _base.begin() + iPos + iLength);
+	}
+
+	void on_remove(size_t, size_t)
+	{
+	}
+
+	template<typename InputIterator>
+	void on_insert(InputIterator iBegin, InputIterator iEnd, size_t)
+	{
+		element_codec<typename Range::value_type>::append(iBegin, iEnd, _target);
+	}
+
+private:
+	const Range& _base;
+	Range& _target;
+};
+
+template<typename Iterator, typename Result>
+class hunk_handler
+{
+public:
+	typedef typename Result::value_type::second_type range_type;
+
+	hunk_handler(Iterator iBase, Result& oResult): _base(iBase), _result(oResult) {}
+
+	void on_equal(size_t iPos, size_t iLength)
+	{
+		_result.push_back(std::make_pair(operation::equal(), range_type(_base + iPos, _base + iPos + iLength)));
+	}
+
+	void on_remove(size_t iPos, size_t iLength)
+	{
+		_result.push_back(std::make_pair(operation::remove(), range_type(_base + iPos, _base + iPos + iLength)));
+	}
+
+	void on_insert(Iterator iBegin, Iterator iEnd, size_t)
+	{
+		_result.push_back(std::make_pair(operation::insert(), range_type(iBegin, iEnd)));
+	}
+
+private:
+	Iterator _base;
+	Result& _result;
+};
+
+}  // namespace detail
+
+/*! Visitor writing streamed hunks in the binary format, usable with compute().
+ */
+template<typename OutputIterator>
+class encoder
+{
+public:
+	explicit encoder(OutputIterator iOutput): _output(iOutput) {}
+
+	template<typename Iterator>
+	void on_equal(Iterator iBegin, Iterator iEnd)
+	{
+		write_header(detail::EQUAL, std::distance(iBegin, iEnd));
+	}
+
+	template<typename Iterator>
+	void on_remove(Iterator iBegin, Iterator iEnd)
+	{
+		write_header(detail::REMOVE, std::distance(iBegin, iEnd));
+	}
+
+	template<typename Iterator>
+	void on_insert(Iterator iBegin, Iterator iEnd)
+	{
+		typedef typename std::iterator_traits<Iterator>::value_type element_type;
+
+		write_header(detail::INSERT, std::distance(iBegin, iEnd));
+		for(; iBegin != iEnd; ++iBegin)
+		{
+			_output = detail::element_codec<element_type>::write(*iBegin, _output);
+		}
+	}
+
+	OutputIterator output() const
+	{
+		return _output;
+	}
+
+private:
+	void write_header(detail::OPERATION iOperation, size_t iLength)
+	{
+		*_output = static_cast<char>(iOperation);
+		++_output;
+		_output = detail::write_varint(iLength, _output);
+	}
+
+	OutputIterator _output;
+};
+
+/*! Writes the edit script in the binary format, no memory is allocated.
+ *
+ * @param iResult result or flat_result
+ * @param oOutput output iterator accepting chars
+ * @return output iterator past the last written byte
+ */
+template<typename Result, typename OutputIterator>
+OutputIterator encode(const Result& iResult, OutputIterator oOutput)
+{
+	encoder<OutputIterator> anEncoder(oOutput);
+	typename Result::const_iterator aResultEnd = iResult.end();
+	for(typename Result::const_iterator aResultIt = iResult.begin(); aResultIt != aResultEnd; ++aResultIt)
+	{
+		typename std::iterator_traits<typename Result::const_iterator>::reference aHunk(*aResultIt);
+		if(aHunk.second.empty())
+		{
+			continue;
+		}
+		if(aHunk.first.isEqual())
+		{
+			anEncoder.on_equal(aHunk.second.begin(), aHunk.second.end());
+		}
+		else if(aHunk.first.isRemove())
+		{
+			anEncoder.on_remove(aHunk.second.begin(), aHunk.second.end());
+		}
+		else
+		{
+			anEncoder.on_insert(aHunk.second.begin(), aHunk.second.end());
+		}
+	}
+	return anEncoder.output();
+}
+
+//! Number of bytes encode() writes for the edit script.
+template<typename Result>
+size_t encoded_size(const Result& iResult)
+{
+	return encode(iResult, detail::counting_iterator()).count();
+}
+
+/*! Reconstructs the target range from the base and the encoded script.
+ *
+ * @param iBase range the script was computed against
+ * @param iBegin begin of the encoded script (forward iterator over bytes)
+ * @param iEnd end of the encoded script
+ * @param oTarget target range, the decoded elements are appended
+ * @return false if the script is malformed or does not match the base
+ */
+template<typename Range, typename InputIterator>
+bool decode(const Range& iBase, InputIterator iBegin, InputIterator iEnd, Range& oTarget)
+{
+	typedef typename Range::value_type element_type;
+
+	detail::size_handler aSizeHandler;
+	if(!detail::parse<element_type>(iBegin, iEnd, iBase.size(), aSizeHandler))
+	{
+		return false;
+	}
+	oTarget.reserve(oTarget.size() + aSizeHandler.size());
+	detail::target_handler<Range> aTargetHandler(iBase, oTarget);
+	detail::parse<element_type>(iBegin, iEnd, iBase.size(), aTargetHandler);
+	return true;
+}
+
+/*! Decodes the script into hunks viewing the base and the encoded buffer.
+ *
+ * Equalities and removals reference the base, insertions the payload inside
+ * the encoded buffer, so both must outlive the result. Only available for
+ * single byte elements. On failure already decoded hunks are left in oResult.
+ *
+ * @param oResult container of (operation, range<Iterator>) pairs
+ * @return false if the script is malformed or does not match the base
+ */
+template<typename Iterator, typename Result>
+bool decode_hunks(Iterator iBaseBegin, Iterator iBaseEnd, Iterator iBegin, Iterator iEnd, Result& oResult)
+{
+	typedef typename std::iterator_traits<Iterator>::value_type element_type;
+	typedef char single_byte_element_required[sizeof(element_type) == 1 ? 1 : -1];
+	(void)sizeof(single_byte_element_required);
+
+	detail::hunk_handler<Iterator, Result> aHandler(iBaseBegin, oResult);
+	return detail::parse<element_type>(iBegin, iEnd, std::distance(iBaseBegin, iBaseEnd), aHandler);
+}
+
+}  // namespace diff
+}  // namespace izi
+
+#endif /* IZI_DIFF_SERIALIZATION_H_ */
@@ -0,0 +1,183 @@
+#ifndef IZI_DIFF_STATS_H_
+#define IZI_DIFF_STATS_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+
+#include "operation.h"
+
+namespace izi {
+namespace diff {
+
+/*! Diff statistics accumulated hunk by hunk.
+ *
+ * Can be used directly as a compute() visitor to get the statistics of two
+ * ranges without storing any hunk.
+ */
+class stats
+{
+public:
+	stats():
+		_equal(0), _inserted(0), _removed(0),
+		_equalHunks(0), _insertHunks(0), _removeHunks(0),
+		_distance(0), _blockInserted(0), _blockRemoved(0) {}
+
+	void add(const operation& iOperation, size_t iLength)
+	{
+		if(iOperation.isEqual())
+		{
+			close_block();
+			_equal += iLength;
+			++_equalHunks;
+		}
+		else if(iOperation.isInsert())
+		{
+			_inserted += iLength;
+			_blockInserted += iLength;
+			++_insertHunks;
+		}
+		else
+		{
+			_removed += iLength;
+			_blockRemoved += iLength;
+			++_removeHunks;
+		}
+	}
+
+	template<typename Iterator>
+	void on_equal(Iterator iBegin, Iterator iEnd)
+	{
+		add(operation::equal(), std::distance(iBegin, iEnd));
+	}
+
+	template<typename Iterator>
+	void on_insert(Iterator iBegin, Iterator iEnd)
+	{
+		add(operation::insert(), std::distance(iBegin, iEnd));
+	}
+
+	template<typename Iterator>
+	void on_remove(Iterator iBegin, Iterator iEnd)
+	{
+		add(operation::remove(), std::distance(iBegin, iEnd));
+	}
+
+	size_t equal() const
+	{
+		return _equal;
+	}
+
+	size_t inserted() const
+	{
+		return _inserted;
+	}
+
+	size_t removed() const
+	{
+		return _removed;
+	}
+
+	size_t equal_hunks() const
+	{
+		return _equalHunks;
+	}
+
+	size_t insert_hunks() const
+	{
+		return _insertHunks;
+	}
+
+	size_t remove_hunks() const
+	{
+		return _removeHunks;
+	}
+
+	size_t hunks() const
+	{
+		return _equalHunks + _insertHunks + _removeHunks;
+	}
+
+	/*! Adds the statistics of the hunks following these ones.
+	 *
+	 * Counts are simply summed, so the distance is exact when these end
+	 * with an equality or the others start with one.
+	 */
+	stats& operator+=(const stats& iStats)
+	{
+		_equal += iStats._equal;
+		_inserted += iStats._inserted;
+		_removed += iStats._removed;
+		_equalHunks += iStats._equalHunks;
+		_insertHunks += iStats._insertHunks;
+		_removeHunks += iStats._removeHunks;
+		_distance += iStats._distance;
+		_blockInserted += iStats._blockInserted;
+		_blockRemoved += iStats._blockRemoved;
+		return *this;
+	}
+
+	/*! Removes the statistics of a run of the hunks, e.g. before it is
+	 *  rewritten and added again.
+	 *
+	 * The run starts at the first hunk or at an equality and ends with an
+	 * equality or at the last hunk, so no change block is split.
+	 */
+	stats& operator-=(const stats& iStats)
+	{
+		_equal -= iStats._equal;
+		_inserted -= iStats._inserted;
+		_removed -= iStats._removed;
+		_equalHunks -= iStats._equalHunks;
+		_insertHunks -= iStats._insertHunks;
+		_removeHunks -= iStats._removeHunks;
+		_distance -= iStats._distance;
+		_blockInserted -= iStats._blockInserted;
+		_blockRemoved -= iStats._blockRemoved;
+		return *this;
+	}
+
+	//! Statistics of the inverted diff, insertions and removals swapped.
+	void invert()
+	{
+		std::swap(_inserted, _removed);
+		std::swap(_insertHunks, _removeHunks);
+		std::swap(_blockInserted, _blockRemoved);
+	}
+
+	//! Levenshtein distance, a replacement counts as a single edit.
+	size_t distance() const
+	{
+		return _distance + std::max(_blockInserted, _blockRemoved);
+	}
+
+	//! Share of equal elements in both ranges, 1.0 for identical ranges.
+	double similarity() const
+	{
+		const size_t aTotal = 2 * _equal + _inserted + _removed;
+		return (aTotal == 0) ? 1.0 : (2.0 * _equal) / aTotal;
+	}
+
+private:
+	void close_block()
+	{
+		_distance += std::max(_blockInserted, _blockRemoved);
+		_blockInserted = 0;
+		_blockRemoved = 0;
+	}
+
+	size_t _equal;
+	size_t _inserted;
+	size_t _removed;
+	size_t _equalHunks;
+	size_t _insertHunks;
+	size_t _removeHunks;
+	size_t _distance;
+	size_t _blockInserted;
+	size_t _blockRemoved;
+};
+
+}  // namespace diff
+}  // namespace izi
+
+#endif /* IZI_DIFF_STATS_H_ */
@@ -1,7 +1,10 @@
 #ifndef DIFF_TYPES_H_
 #define DIFF_TYPES_H_
 
+#include <functional>
+#include <iterator>
 #include <map>
+#include <memory>
 #include <vector>
 
 #include <string>
@@ -11,11 +14,59 @@ namespace diff {
 
 typedef unsigned long line_index;
 
+//! Settings of the calculation.
+struct options
+{
+	options(): _minimal(false) {}
+	explicit options(bool iMinimal): _minimal(iMinimal) {}
+
+	//! Only minimal edit scripts, heuristics splitting the ranges are skipped.
+	bool _minimal;
+};
+
+/*! Allocator of the same family for another value type.
+ */
+template<typename Allocator, typename T>
+struct rebind_allocator
+{
+#if __cplusplus >= 201103L
+	typedef typename std::allocator_traits<Allocator>::template rebind_alloc<T> type;
+#else
+	typedef typename Allocator::template rebind<T>::other type;
+#endif
+};
+
 template<typename Iterator>
 struct range
 {
+	typedef Iterator iterator;
+	typedef Iterator const_iterator;
+	typedef typename std::iterator_traits<Iterator>::value_type value_type;
+	typedef size_t size_type;
+
+	range(): _begin(), _end() {}
 	range(Iterator iBegin, Iterator iEnd): _begin(iBegin), _end(iEnd) {}
 
+	Iterator begin() const
+	{
+		return _begin;
+	}
+
+	Iterator end() const
+	{
+		return _end;
+	}
+
+	size_type size() const
+	{
+		return std::distance(_begin, _end);
+	}
+
+	bool empty() const
+	{
+		return _begin == _end;
+	}
+
 	bool operator<(const range iRange) const
 	{
 		return std::lexicographical_compare(_begin, _end, iRange._begin, iRange._end);
@@ -25,18 +76,26 @@ struct range
 	Iterator _end;
 };
 
-template<typename Iterator>
+template<typename Iterator, typename Allocator = std::allocator<void> >
 struct range_vector
 {
-	typedef std::vector<range<Iterator> > type;
+	typedef std::vector<range<Iterator>, typename rebind_allocator<Allocator, range<Iterator> >::type> type;
 };
 
 typedef std::vector<line_index> line_vector;
 
-template<typename Iterator>
+//! line_vector allocating from the family of Allocator.
+template<typename Allocator = std::allocator<void> >
+struct line_index_vector
+{
+	typedef std::vector<line_index, typename rebind_allocator<Allocator, line_index>::type> type;
+};
+
+template<typename Iterator, typename Allocator = std::allocator<void> >
 struct line_map
 {
-	typedef std::map<range<Iterator>, line_index> type;
+	typedef std::map<range<Iterator>, line_index, std::less<range<Iterator> >,
+			typename rebind_allocator<Allocator, std::pair<const range<Iterator>, line_index> >::type> type;
 };
 
 }  // namespace diff
@@ -0,0 +1,511 @@
+#ifndef IZI_DIFF_UNIFIED_H_
+#define IZI_DIFF_UNIFIED_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "calculation.h"
+#include "operation.h"
+#include "range_traits.h"
+#include "types.h"
+
+namespace izi {
+namespace diff {
+
+//! Default number of unchanged lines around the changes of a unified diff.
+const size_t kDefaultUnifiedContext = 3;
+
+namespace detail {
+
+//! Size of the buffer unified diffs are written through.
+const size_t kUnifiedBufferSize = 4096;
+
+//! Pre-context segments kept before they are compacted.
+const size_t kUnifiedCompactSize = 256;
+
+}  // namespace detail
+
+/*! Visitor writing streamed hunks as a unified diff, usable with compute().
+ *
+ * Hunks of any granularity are accepted, e.g. of a line mode result with
+ * elements diffed inside changed lines. Lines made of equal elements only
+ * are context, all other lines up to the next point where both ranges are
+ * at the beginning of a line are a change. The removed and inserted lines
+ * of a change are diffed again as lines, the ones found on both sides are
+ * context too.
+ *
+ * Lines are kept as views into the hunks until their hunk of the unified
+ * diff is complete, so only one hunk is held at a time. Output goes through
+ * a small buffer to the sink, which only needs write(const char*, size),
+ * e.g. std::ostream. flush() must be called after the last hunk.
+ *
+ * @param Iterator iterator over the chars of the hunks
+ */
+template<typename Sink, typename Iterator>
+class unified_writer
+{
+public:
+	unified_writer(Sink& ioSink, const std::string& iName1, const std::string& iName2,
+			size_t iContext = kDefaultUnifiedContext):
+		_sink(ioSink), _name1(iName1), _name2(iName2), _context(iContext), _used(0),
+		_headerWritten(false), _open(false), _changed(false), _trailing(0),
+		_line1(0), _line2(0), _start1(0), _start2(0), _hunk1(0), _hunk2(0) {}
+
+	void on_equal(Iterator iBegin, Iterator iEnd)
+	{
+		while(iBegin != iEnd)
+		{
+			const Iterator aLineEnd = line_end(iBegin, iEnd);
+			_pending1.push_back(segment(iBegin, aLineEnd));
+			_pending2.push_back(segment(iBegin, aLineEnd));
+			if(*(aLineEnd - 1) == '\n')
+			{
+				end_common_line(true);
+			}
+			iBegin = aLineEnd;
+		}
+	}
+
+	void on_remove(Iterator iBegin, Iterator iEnd)
+	{
+		while(iBegin != iEnd)
+		{
+			const Iterator aLineEnd = line_end(iBegin, iEnd);
+			start_change();
+			_pending1.push_back(segment(iBegin, aLineEnd));
+			if(*(aLineEnd - 1) == '\n')
+			{
+				end_line(_pending1, '-', true, _removed);
+				++_line1;
+			}
+			iBegin = aLineEnd;
+		}
+	}
+
+	void on_insert(Iterator iBegin, Iterator iEnd)
+	{
+		while(iBegin != iEnd)
+		{
+			const Iterator aLineEnd = line_end(iBegin, iEnd);
+			start_change();
+			_pending2.push_back(segment(iBegin, aLineEnd));
+			if(*(aLineEnd - 1) == '\n')
+			{
+				end_line(_pending2, '+', true, _inserted);
+				++_line2;
+			}
+			iBegin = aLineEnd;
+		}
+	}
+
+	//! Writes the last lines and hunk and empties the buffer into the sink.
+	void flush()
+	{
+		if(!_changed && !_pending1.empty())
+		{
+			end_common_line(false);
+		}
+		else if(_changed)
+		{
+			if(!_pending1.empty())
+			{
+				end_line(_pending1, '-', false, _removed);
+			}
+			if(!_pending2.empty())
+			{
+				end_line(_pending2, '+', false, _inserted);
+			}
+			end_change();
+		}
+		if(_open)
+		{
+			write_hunk(_lines.size() - (_trailing > _context ? _trailing - _context : 0));
+		}
+		flush_buffer();
+	}
+
+private:
+	typedef std::pair<Iterator, Iterator> segment;
+
+	//! Line of the unified diff, its text are the segments [_first, _last).
+	struct line
+	{
+		line(char iTag, size_t iFirst, size_t iLast, bool iEndl):
+			_tag(iTag), _first(iFirst), _last(iLast), _endl(iEndl) {}
+
+		char _tag;
+		size_t _first;
+		size_t _last;
+		bool _endl;
+	};
+
+	static Iterator line_end(Iterator iBegin, Iterator iEnd)
+	{
+		const Iterator anEndl = std::find(iBegin, iEnd, '\n');
+		return (anEndl != iEnd) ? anEndl + 1 : iEnd;
+	}
+
+	void start_change()
+	{
+		if(!_changed)
+		{
+			_changed = true;
+			_start1 = _line1;
+			_start2 = _line2;
+		}
+	}
+
+	void end_line(std::vector<segment>& ioPending, char iTag, bool iEndl, std::vector<line>& oLines)
+	{
+		oLines.push_back(line(iTag, _segments.size(), _segments.size() + ioPending.size(), iEndl));
+		_segments.insert(_segments.end(), ioPending.begin(), ioPending.end());
+		ioPending.clear();
+	}
+
+	//! Both ranges reached the end of a line.
+	void end_common_line(bool iEndl)
+	{
+		if(!_changed)
+		{
+			end_line(_pending1, ' ', iEndl, _lines);
+			_pending2.clear();
+			++_line1;
+			++_line2;
+			add_context();
+			return;
+		}
+		end_line(_pending1, '-', iEndl, _removed);
+		end_line(_pending2, '+', iEndl, _inserted);
+		++_line1;
+		++_line2;
+		end_change();
+	}
+
+	//! Moves the removed and inserted lines of the change into the hunk.
+	void end_change()
+	{
+		if(_removed.empty() || _inserted.empty())
+		{
+			add_change(0, _removed.size(), 0, _inserted.size());
+		}
+		else
+		{
+			realign_change();
+		}
+		_removed.clear();
+		_inserted.clear();
+		_changed = false;
+	}
+
+	//! Adds the removed lines [iBegin1, iEnd1) and inserted lines [iBegin2, iEnd2) of the change.
+	void add_change(size_t iBegin1, size_t iEnd1, size_t iBegin2, size_t iEnd2)
+	{
+		if(!_open)
+		{
+			_open = true;
+			_hunk1 = _start1 + iBegin1 - _lines.size();
+			_hunk2 = _start2 + iBegin2 - _lines.size();
+		}
+		_lines.insert(_lines.end(), _removed.begin() + iBegin1, _removed.begin() + iEnd1);
+		_lines.insert(_lines.end(), _inserted.begin() + iBegin2, _inserted.begin() + iEnd2);
+		_trailing = 0;
+	}
+
+	//! Diffs the removed and inserted lines, common lines become context.
+	void realign_change()
+	{
+		typedef std::vector<line_index>::const_iterator index_iterator;
+		typedef std::list<std::pair<operation, range<index_iterator> > > index_diff;
+
+		std::map<std::string, line_index> aKeys;
+		_indices1.clear();
+		_indices2.clear();
+		line_indices(_removed, aKeys, _indices1);
+		line_indices(_inserted, aKeys, _indices2);
+		index_diff aDiff;
+		const std::vector<line_index>& anIndices1(_indices1);
+		const std::vector<line_index>& anIndices2(_indices2);
+		detail::calculate_hunks<detail::void_traits>(anIndices1.begin(), anIndices1.end(), anIndices2.begin(),
+				anIndices2.end(), aDiff, options(true));
+
+		size_t anIndex1(0);
+		size_t anIndex2(0);
+		size_t aChange1(0);
+		size_t aChange2(0);
+		for(typename index_diff::const_iterator aHunkIt = aDiff.begin(); ; ++aHunkIt)
+		{
+			const bool anEnd = (aHunkIt == aDiff.end());
+			if((anEnd || aHunkIt->first.isEqual()) && ((aChange1 != anIndex1) || (aChange2 != anIndex2)))
+			{
+				add_change(aChange1, anIndex1, aChange2, anIndex2);
+			}
+			if(anEnd)
+			{
+				break;
+			}
+
+			const size_t aSize = aHunkIt->second.size();
+			if(aHunkIt->first.isEqual())
+			{
+				for(size_t aLine = anIndex1; aLine < anIndex1 + aSize; ++aLine)
+				{
+					_lines.push_back(_removed[aLine]);
+					_lines.back()._tag = ' ';
+					// Lines of the change still reference the segments
+					add_context(false);
+				}
+				anIndex1 += aSize;
+				anIndex2 += aSize;
+				aChange1 = anIndex1;
+				aChange2 = anIndex2;
+			}
+			else if(aHunkIt->first.isRemove())
+			{
+				anIndex1 += aSize;
+			}
+			else
+			{
+				anIndex2 += aSize;
+			}
+		}
+	}
+
+	void line_indices(const std::vector<line>& iLines, std::map<std::string, line_index>& ioKeys,
+			std::vector<line_index>& oIndices) const
+	{
+		std::string aKey;
+		for(typename std::vector<line>::const_iterator aLineIt = iLines.begin(); aLineIt != iLines.end(); ++aLineIt)
+		{
+			aKey.clear();
+			for(size_t aSegment = aLineIt->_first; aSegment < aLineIt->_last; ++aSegment)
+			{
+				aKey.append(_segments[aSegment].first, _segments[aSegment].second);
+			}
+			oIndices.push_back(ioKeys.insert(std::make_pair(aKey, ioKeys.size())).first->second);
+		}
+	}
+
+	void add_context(bool iCompact = true)
+	{
+		if(_open)
+		{
+			if(++_trailing <= 2 * _context)
+			{
+				return;
+			}
+			// Too far from the next change, the hunk ends and its last lines
+			// are the context of the next one
+			write_hunk(_lines.size() - _trailing + _context);
+			_lines.erase(_lines.begin(), _lines.end() - _context);
+			_open = false;
+		}
+		else if(_lines.size() > _context)
+		{
+			_lines.erase(_lines.begin());
+		}
+
+		if(!iCompact)
+		{
+			return;
+		}
+		if(_lines.empty())
+		{
+			_segments.clear();
+		}
+		else if(_lines.front()._first > detail::kUnifiedCompactSize)
+		{
+			const size_t aFirst = _lines.front()._first;
+			_segments.erase(_segments.begin(), _segments.begin() + aFirst);
+			for(typename std::vector<line>::iterator aLineIt = _lines.begin(); aLineIt != _lines.end(); ++aLineIt)
+			{
+				aLineIt->_first -= aFirst;
+				aLineIt->_last -= aFirst;
+			}
+		}
+	}
+
+	//! Writes the first iCount lines as a hunk.
+	void write_hunk(size_t iCount)
+	{
+		if(!_headerWritten)
+		{
+			put("--- ");
+			put(_name1.begin(), _name1.end());
+			put("\n+++ ");
+			put(_name2.begin(), _name2.end());
+			put("\n");
+			_headerWritten = true;
+		}
+
+		size_t aCount1(0);
+		size_t aCount2(0);
+		for(size_t anIndex = 0; anIndex < iCount; ++anIndex)
+		{
+			aCount1 += (_lines[anIndex]._tag != '+') ? 1 : 0;
+			aCount2 += (_lines[anIndex]._tag != '-') ? 1 : 0;
+		}
+		put("@@ -");
+		put_range(_hunk1, aCount1);
+		put(" +");
+		put_range(_hunk2, aCount2);
+		put(" @@\n");
+
+		for(size_t anIndex = 0; anIndex < iCount; ++anIndex)
+		{
+			const line& aLine = _lines[anIndex];
+			put(aLine._tag);
+			for(size_t aSegment = aLine._first; aSegment < aLine._last; ++aSegment)
+			{
+				put(_segments[aSegment].first, _segments[aSegment].second);
+			}
+			if(!aLine._endl)
+			{
+				put("\n\\ No newline at end of file\n");
+			}
+		}
+	}
+
+	//! Start and size of a hunk range, the start of an empty one is the line before it.
+	void put_range(size_t iStart, size_t iCount)
+	{
+		put_number((iCount > 0) ? iStart + 1 : iStart);
+		if(iCount != 1)
+		{
+			put(',');
+			put_number(iCount);
+		}
+	}
+
+	void put_number(size_t iValue)
+	{
+		char aDigits[24];
+		char* aDigitIt = aDigits + sizeof(aDigits);
+		do
+		{
+			*--aDigitIt = static_cast<char>('0' + iValue % 10);
+			iValue /= 10;
+		}
+		while(iValue > 0);
+		put(aDigitIt, aDigits + sizeof(aDigits));
+	}
+
+	void put(char iChar)
+	{
+		if(_used == detail::kUnifiedBufferSize)
+		{
+			flush_buffer();
+		}
+		_buffer[_used++] = iChar;
+	}
+
+	void put(const char* iText)
+	{
+		for(; *iText != '\0'; ++iText)
+		{
+			put(*iText);
+		}
+	}
+
+	template<typename CharIterator>
+	void put(CharIterator iBegin, CharIterator iEnd)
+	{
+		while(iBegin != iEnd)
+		{
+			if(_used == detail::kUnifiedBufferSize)
+			{
+				flush_buffer();
+			}
+			const size_t aSize = std::min<size_t>(detail::kUnifiedBufferSize - _used, std::distance(iBegin, iEnd));
+			const CharIterator aChunkEnd = iBegin + aSize;
+			std::copy(iBegin, aChunkEnd, _buffer + _used);
+			_used += aSize;
+			iBegin = aChunkEnd;
+		}
+	}
+
+	void flush_buffer()
+	{
+		if(_used > 0)
+		{
+			_sink.write(_buffer, _used);
+			_used = 0;
+		}
+	}
+
+	Sink& _sink;
+	const std::string _name1;
+	const std::string _name2;
+	const size_t _context;
+	char _buffer[detail::kUnifiedBufferSize];
+	size_t _used;
+
+	bool _headerWritten;
+	//! Whether the hunk in _lines has changes or only pre-context.
+	bool _open;
+	//! Whether the current lines have changes.
+	bool _changed;
+	//! Context lines after the last change of the hunk.
+	size_t _trailing;
+	//! Lines completed in the first and the second range.
+	size_t _line1;
+	size_t _line2;
+	//! Lines before the current change.
+	size_t _start1;
+	size_t _start2;
+	//! Lines before the current hunk.
+	size_t _hunk1;
+	size_t _hunk2;
+
+	std::vector<segment> _pending1;
+	std::vector<segment> _pending2;
+	std::vector<segment> _segments;
+	std::vector<line> _lines;
+	std::vector<line> _removed;
+	std::vector<line> _inserted;
+	std::vector<line_index> _indices1;
+	std::vector<line_index> _indices2;
+};
+
+/*! Writes the edit script of two texts as a unified diff.
+ *
+ * @param iResult result or flat_result of char ranges
+ * @param ioSink sink with write(const char*, size), e.g. std::ostream
+ * @param iName1 name of the first text in the header
+ * @param iName2 name of the second text in the header
+ * @param iContext number of unchanged lines around changes
+ */
+template<typename Result, typename Sink>
+void write_unified(const Result& iResult, Sink& ioSink, const std::string& iName1, const std::string& iName2,
+		size_t iContext = kDefaultUnifiedContext)
+{
+	typedef typename Result::value_type::second_type::const_iterator iterator;
+
+	unified_writer<Sink, iterator> aWriter(ioSink, iName1, iName2, iContext);
+	typename Result::const_iterator aResultEnd = iResult.end();
+	for(typename Result::const_iterator aResultIt = iResult.begin(); aResultIt != aResultEnd; ++aResultIt)
+	{
+		if(aResultIt->first.isEqual())
+		{
+			aWriter.on_equal(aResultIt->second.begin(), aResultIt->second.end());
+		}
+		else if(aResultIt->first.isRemove())
+		{
+			aWriter.on_remove(aResultIt->second.begin(), aResultIt->second.end());
+		}
+		else
+		{
+			aWriter.on_insert(aResultIt->second.begin(), aResultIt->second.end());
+		}
+	}
+	aWriter.flush();
+}
+
+}  // namespace diff
+}  // namespace izi
+
+#endif /* IZI_DIFF_UNIFIED_H_ */
@@ -0,0 +1,134 @@
+#ifndef IZI_DIFF_VISITOR_SINK_H_
+#define IZI_DIFF_VISITOR_SINK_H_
+
+#include <memory>
+#include <utility>
+
+#include "algorithm.h"
+#include "operation.h"
+#include "types.h"
+
+namespace izi {
+namespace diff {
+namespace detail {
+
+/*! Result replacement forwarding hunks to a visitor as soon as they are final.
+ *
+ * Hunks pushed by the calculation are only used for their length, the sink
+ * keeps cursors into both ranges and holds back at most one equality and one
+ * change block (removed and inserted views). Adjacent hunks are merged and
+ * the common prefix and suffix of a change block are moved to the
+ * surrounding equalities, as in cleanup_first_pass. Equalities are reported
+ * as views into the first range.
+ */
+template<typename Visitor, typename Iterator, typename Allocator = std::allocator<void> >
+class visitor_sink
+{
+public:
+	typedef std::pair<operation, range<Iterator> > value_type;
+	typedef Allocator allocator_type;
+
+	visitor_sink(Visitor& ioVisitor, Iterator iBegin1, Iterator iBegin2, const allocator_type& iAllocator = allocator_type()):
+		_allocator(iAllocator),
+		_visitor(ioVisitor),
+		_it1(iBegin1), _it2(iBegin2),
+		_equalIt(iBegin1),
+		_changeIt1(iBegin1), _changeIt2(iBegin2) {}
+
+	void push_back(const value_type& iValue)
+	{
+		const size_t aSize = iValue.second.size();
+		if(aSize == 0)
+		{
+			return;
+		}
+		if(iValue.first.isEqual())
+		{
+			flush_changes();
+			_it1 += aSize;
+			_it2 += aSize;
+			_changeIt1 = _it1;
+			_changeIt2 = _it2;
+		}
+		else if(iValue.first.isRemove())
+		{
+			_it1 += aSize;
+		}
+		else
+		{
+			_it2 += aSize;
+		}
+	}
+
+	//! Allocator used for the temporary storage of the calculation.
+	allocator_type get_allocator() const
+	{
+		return _allocator;
+	}
+
+	//! Reports all pending hunks, must be called after the calculation.
+	void flush()
+	{
+		flush_changes();
+		if(_equalIt != _it1)
+		{
+			_visitor.on_equal(_equalIt, _it1);
+			_equalIt = _it1;
+		}
+	}
+
+private:
+	void flush_changes()
+	{
+		if((_changeIt1 == _it1) && (_changeIt2 == _it2))
+		{
+			return;
+		}
+		Iterator aSfxIt1 = _it1;
+		Iterator aSfxIt2 = _it2;
+		if((_changeIt1 != _it1) && (_changeIt2 != _it2))
+		{
+			Iterator aPfxIt = common_prefix(_changeIt1, _it1, _changeIt2, _it2);
+			_changeIt2 += aPfxIt - _changeIt1;
+			_changeIt1 = aPfxIt;
+			aSfxIt1 = common_suffix(_changeIt1, _it1, _changeIt2, _it2);
+			aSfxIt2 -= _it1 - aSfxIt1;
+			if((_changeIt1 == aSfxIt1) && (_changeIt2 == aSfxIt2))
+			{
+				// Equal views, the equality goes on
+				_changeIt1 = _it1;
+				_changeIt2 = _it2;
+				return;
+			}
+		}
+		if(_equalIt != _changeIt1)
+		{
+			_visitor.on_equal(_equalIt, _changeIt1);
+		}
+		if(_changeIt1 != aSfxIt1)
+		{
+			_visitor.on_remove(_changeIt1, aSfxIt1);
+		}
+		if(_changeIt2 != aSfxIt2)
+		{
+			_visitor.on_insert(_changeIt2, aSfxIt2);
+		}
+		_equalIt = aSfxIt1;
+		_changeIt1 = _it1;
+		_changeIt2 = _it2;
+	}
+
+	allocator_type _allocator;
+	Visitor& _visitor;
+	Iterator _it1;
+	Iterator _it2;
+	Iterator _equalIt;
+	Iterator _changeIt1;
+	Iterator _changeIt2;
+};
+
+}  // namespace detail
+}  // namespace diff
+}  // namespace izi
+
+#endif /* IZI_DIFF_VISITOR_SINK_H_ */
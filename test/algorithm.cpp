@@ -1,8 +1,17 @@
+#include <list>
 #include <string>
+#include <vector>
 
 #include <gtest/gtest.h>
 
 #include <internal/algorithm.h>
+#include <internal/block_match.h>
+#include <internal/calculation.h>
+#include <internal/cleanup.h>
+#include <internal/efficiency_cleanup.h>
+#include <internal/match.h>
+#include <internal/range_traits.h>
+#include <internal/semantic_cleanup.h>
 
 using namespace izi::diff;
 
@@ -82,3 +91,419 @@ TEST(algorithm, common_prefix)
 	aPfxIt = detail::common_prefix(aString1.begin(), aString1.end(), aString2.begin(), aString2.end());
 	EXPECT_EQ(aPfxIt, aString1.end());
 }
+
+TEST(algorithm, cleanup)
+{
+	typedef std::list<std::pair<operation, std::string> > hunk_list;
+
+	// Every removal can be shifted right across the following equality
+	hunk_list aResult;
+	std::string aText1;
+	std::string aText2;
+	for(size_t i = 0; i < 10000; ++i)
+	{
+		aResult.push_back(std::make_pair(operation::equal(), std::string("xy")));
+		aResult.push_back(std::make_pair(operation::remove(), std::string("xy")));
+		aText1 += "xyxy";
+		aText2 += "xy";
+	}
+	detail::cleanup(aResult);
+
+	ASSERT_EQ(3U, aResult.size());
+	std::string aCheck1;
+	std::string aCheck2;
+	for(hunk_list::const_iterator anIt = aResult.begin(); anIt != aResult.end(); ++anIt)
+	{
+		aCheck1 += anIt->first.isInsert() ? "" : anIt->second;
+		aCheck2 += anIt->first.isRemove() ? "" : anIt->second;
+	}
+	EXPECT_EQ(aText1, aCheck1);
+	EXPECT_EQ(aText2, aCheck2);
+}
+
+TEST(algorithm, cleanup_first_pass)
+{
+	typedef std::pair<operation, std::string> hunk;
+	typedef std::list<hunk> hunk_list;
+
+	// Interleaved runs are merged, their common prefix and suffix move into
+	// the neighbouring equalities
+	hunk_list aResult;
+	aResult.push_back(hunk(operation::equal(), "ab"));
+	aResult.push_back(hunk(operation::insert(), "xr"));
+	aResult.push_back(hunk(operation::remove(), "xq"));
+	aResult.push_back(hunk(operation::insert(), "wz"));
+	aResult.push_back(hunk(operation::remove(), "yz"));
+	aResult.push_back(hunk(operation::equal(), "cd"));
+	detail::cleanup_first_pass(aResult);
+	hunk_list anExpected;
+	anExpected.push_back(hunk(operation::equal(), "abx"));
+	anExpected.push_back(hunk(operation::remove(), "qy"));
+	anExpected.push_back(hunk(operation::insert(), "rw"));
+	anExpected.push_back(hunk(operation::equal(), "zcd"));
+	EXPECT_TRUE(aResult == anExpected);
+
+	// Without neighbouring equalities new ones are created
+	aResult.clear();
+	aResult.push_back(hunk(operation::remove(), "abc"));
+	aResult.push_back(hunk(operation::insert(), "axc"));
+	detail::cleanup_first_pass(aResult);
+	anExpected.clear();
+	anExpected.push_back(hunk(operation::equal(), "a"));
+	anExpected.push_back(hunk(operation::remove(), "b"));
+	anExpected.push_back(hunk(operation::insert(), "x"));
+	anExpected.push_back(hunk(operation::equal(), "c"));
+	EXPECT_TRUE(aResult == anExpected);
+
+	// Adjacent equalities are merged, also across empty hunks and edits
+	// which cancel out
+	aResult.clear();
+	aResult.push_back(hunk(operation::equal(), "a"));
+	aResult.push_back(hunk(operation::equal(), "b"));
+	aResult.push_back(hunk(operation::insert(), ""));
+	aResult.push_back(hunk(operation::equal(), "c"));
+	aResult.push_back(hunk(operation::remove(), "de"));
+	aResult.push_back(hunk(operation::insert(), "de"));
+	aResult.push_back(hunk(operation::equal(), "f"));
+	detail::cleanup_first_pass(aResult);
+	ASSERT_EQ(1U, aResult.size());
+	EXPECT_TRUE(aResult.front() == hunk(operation::equal(), "abcdef"));
+}
+
+TEST(algorithm, cleanup_isolated_changes)
+{
+	typedef std::list<std::pair<operation, std::string> > hunk_list;
+	typedef detail::range_traits<std::string> traits;
+
+	// Shifted right to word boundaries
+	hunk_list aResult;
+	aResult.push_back(std::make_pair(operation::equal(), std::string("The c")));
+	aResult.push_back(std::make_pair(operation::insert(), std::string("at c")));
+	aResult.push_back(std::make_pair(operation::equal(), std::string("ame.")));
+	detail::cleanup_isolated_changes<traits>(aResult);
+
+	ASSERT_EQ(3U, aResult.size());
+	EXPECT_EQ("The ", aResult.front().second);
+	EXPECT_EQ("cat ", detail::next(aResult.begin())->second);
+	EXPECT_EQ("came.", aResult.back().second);
+
+	// Shifted left to the end of a sentence
+	aResult.clear();
+	aResult.push_back(std::make_pair(operation::equal(), std::string("The xxx. The ")));
+	aResult.push_back(std::make_pair(operation::insert(), std::string("zzz. The ")));
+	aResult.push_back(std::make_pair(operation::equal(), std::string("yyy.")));
+	detail::cleanup_isolated_changes<traits>(aResult);
+
+	ASSERT_EQ(3U, aResult.size());
+	EXPECT_EQ("The xxx.", aResult.front().second);
+	EXPECT_EQ(" The zzz.", detail::next(aResult.begin())->second);
+	EXPECT_EQ(" The yyy.", aResult.back().second);
+
+	// Shifted to the edge, the equality disappears
+	aResult.clear();
+	aResult.push_back(std::make_pair(operation::equal(), std::string("a")));
+	aResult.push_back(std::make_pair(operation::remove(), std::string("a")));
+	aResult.push_back(std::make_pair(operation::equal(), std::string("ax")));
+	detail::cleanup_isolated_changes<traits>(aResult);
+
+	ASSERT_EQ(2U, aResult.size());
+	EXPECT_TRUE(aResult.front().first.isRemove());
+	EXPECT_EQ("a", aResult.front().second);
+	EXPECT_EQ("aax", aResult.back().second);
+}
+
+TEST(algorithm, semantic_score)
+{
+	typedef detail::range_traits<std::string> traits;
+	typedef detail::range_traits<std::wstring> wide_traits;
+
+	const std::string anEmpty;
+	const std::string aWord("word");
+	EXPECT_EQ(6, detail::semantic_score<traits>(anEmpty.begin(), anEmpty.end(), aWord.begin(), aWord.end()));
+
+	const char* aCases[][3] =
+	{
+		{"ab", "cd", "0"},
+		{"ab", "-cd", "1"},
+		{"ab", " cd", "2"},
+		{"end.", " next", "3"},
+		{"end", "\n", "4"},
+		{"end\n\n", "next", "5"},
+		{"tab\t", "x", "2"},
+		{"caf\xC3", "\xA9", "0"}
+	};
+	for(size_t i = 0; i < sizeof(aCases) / sizeof(aCases[0]); ++i)
+	{
+		const std::string aText1(aCases[i][0]);
+		const std::string aText2(aCases[i][1]);
+		EXPECT_EQ(aCases[i][2][0] - '0', detail::semantic_score<traits>(aText1.begin(), aText1.end(), aText2.begin(), aText2.end())) << i;
+	}
+
+	const std::wstring aText1(L"line\x2028");
+	const std::wstring aText2(L"\x00E9t\x00E9");
+	EXPECT_EQ(4, detail::semantic_score<wide_traits>(aText1.begin(), aText1.end(), aText2.begin(), aText2.end()));
+	EXPECT_EQ(0, detail::semantic_score<wide_traits>(aText2.begin(), aText2.end(), aText2.begin(), aText2.end()));
+}
+
+TEST(algorithm, cleanup_efficiency)
+{
+	typedef std::list<std::pair<operation, std::string> > hunk_list;
+
+	// No elimination
+	hunk_list aResult;
+	aResult.push_back(std::make_pair(operation::remove(), std::string("ab")));
+	aResult.push_back(std::make_pair(operation::insert(), std::string("12")));
+	aResult.push_back(std::make_pair(operation::equal(), std::string("wxyz")));
+	aResult.push_back(std::make_pair(operation::remove(), std::string("cd")));
+	aResult.push_back(std::make_pair(operation::insert(), std::string("34")));
+	hunk_list aCopy(aResult);
+	detail::cleanup_efficiency(aCopy);
+	EXPECT_TRUE(aCopy == aResult);
+
+	// Higher edit cost
+	detail::cleanup_efficiency(aResult, 5);
+	ASSERT_EQ(2U, aResult.size());
+	EXPECT_EQ("abwxyzcd", aResult.front().second);
+	EXPECT_EQ("12wxyz34", aResult.back().second);
+
+	// Three edits
+	aResult.clear();
+	aResult.push_back(std::make_pair(operation::insert(), std::string("12")));
+	aResult.push_back(std::make_pair(operation::equal(), std::string("x")));
+	aResult.push_back(std::make_pair(operation::remove(), std::string("cd")));
+	aResult.push_back(std::make_pair(operation::insert(), std::string("34")));
+	detail::cleanup_efficiency(aResult);
+	ASSERT_EQ(2U, aResult.size());
+	EXPECT_TRUE(aResult.front().first.isRemove());
+	EXPECT_EQ("xcd", aResult.front().second);
+	EXPECT_EQ("12x34", aResult.back().second);
+
+	// Elimination reaching back to the previous equality
+	aResult.clear();
+	aResult.push_back(std::make_pair(operation::remove(), std::string("ab")));
+	aResult.push_back(std::make_pair(operation::insert(), std::string("12")));
+	aResult.push_back(std::make_pair(operation::equal(), std::string("xy")));
+	aResult.push_back(std::make_pair(operation::insert(), std::string("34")));
+	aResult.push_back(std::make_pair(operation::equal(), std::string("z")));
+	aResult.push_back(std::make_pair(operation::remove(), std::string("cd")));
+	aResult.push_back(std::make_pair(operation::insert(), std::string("56")));
+	detail::cleanup_efficiency(aResult);
+	ASSERT_EQ(2U, aResult.size());
+	EXPECT_EQ("abxyzcd", aResult.front().second);
+	EXPECT_EQ("12xy34z56", aResult.back().second);
+}
+
+TEST(algorithm, cleanup_change_overlaps)
+{
+	typedef std::list<std::pair<operation, std::string> > hunk_list;
+
+	std::string aText1("abcxxx");
+	std::string aText2("xxxdef");
+	EXPECT_EQ(3U, detail::common_overlap(aText1.begin(), aText1.end(), aText2.begin(), aText2.end()));
+	EXPECT_EQ(0U, detail::common_overlap(aText2.begin(), aText2.end(), aText1.begin(), aText1.end()));
+	aText1 = "fi";
+	aText2 = "\xef\xac\x81i";
+	EXPECT_EQ(0U, detail::common_overlap(aText1.begin(), aText1.end(), aText2.begin(), aText2.end()));
+
+	// Overlap
+	hunk_list aResult;
+	aResult.push_back(std::make_pair(operation::remove(), std::string("abcxxx")));
+	aResult.push_back(std::make_pair(operation::insert(), std::string("xxxdef")));
+	detail::cleanup_change_overlaps(aResult);
+	ASSERT_EQ(3U, aResult.size());
+	EXPECT_EQ("abc", aResult.front().second);
+	EXPECT_EQ("xxx", detail::next(aResult.begin())->second);
+	EXPECT_TRUE(detail::next(aResult.begin())->first.isEqual());
+	EXPECT_EQ("def", aResult.back().second);
+
+	// Reverse overlap
+	aResult.clear();
+	aResult.push_back(std::make_pair(operation::remove(), std::string("xxxabc")));
+	aResult.push_back(std::make_pair(operation::insert(), std::string("defxxx")));
+	detail::cleanup_change_overlaps(aResult);
+	ASSERT_EQ(3U, aResult.size());
+	EXPECT_TRUE(aResult.front().first.isInsert());
+	EXPECT_EQ("def", aResult.front().second);
+	EXPECT_EQ("xxx", detail::next(aResult.begin())->second);
+	EXPECT_TRUE(aResult.back().first.isRemove());
+	EXPECT_EQ("abc", aResult.back().second);
+
+	// Overlap too small
+	aResult.clear();
+	aResult.push_back(std::make_pair(operation::remove(), std::string("abcxx")));
+	aResult.push_back(std::make_pair(operation::insert(), std::string("xxdefg")));
+	hunk_list aCopy(aResult);
+	detail::cleanup_change_overlaps(aResult);
+	EXPECT_TRUE(aCopy == aResult);
+}
+
+TEST(algorithm, find_subrange)
+{
+	std::string aText(1000, 'a');
+	std::string aPattern(100, 'a');
+	aPattern += 'b';
+	EXPECT_TRUE(detail::find_subrange(aText.begin(), aText.end(), aPattern.begin(), aPattern.end()) == aText.end());
+
+	aText += aPattern + "cd";
+	EXPECT_TRUE(detail::find_subrange(aText.begin(), aText.end(), aPattern.begin(), aPattern.end()) == aText.begin() + 1000);
+
+	// Elements sharing the lowest byte
+	std::vector<unsigned long> aValues(aText.begin(), aText.end());
+	std::vector<unsigned long> aSearched(aPattern.begin(), aPattern.end());
+	aValues[1100] += 256;
+	EXPECT_TRUE(detail::find_subrange(aValues.begin(), aValues.end(), aSearched.begin(), aSearched.end()) == aValues.end());
+
+	std::vector<std::string> aLines(100, "line");
+	std::vector<std::string> aLine(1, "other");
+	aLines[70] = "other";
+	EXPECT_TRUE(detail::find_subrange(aLines.begin(), aLines.end(), aLine.begin(), aLine.end()) == aLines.begin() + 70);
+}
+
+TEST(algorithm, half_match)
+{
+	typedef std::list<std::pair<operation, std::string> > hunk_list;
+
+	const std::string aText1("1234567890");
+	const std::string aText2("a345678z");
+	hunk_list aResult;
+	EXPECT_TRUE(detail::half_match<detail::void_traits>(aText1.begin(), aText1.end(), aText2.begin(), aText2.end(), aResult, options()));
+	hunk_list::const_iterator anEqualIt = aResult.begin();
+	while((anEqualIt != aResult.end()) && !anEqualIt->first.isEqual())
+	{
+		++anEqualIt;
+	}
+	ASSERT_TRUE(anEqualIt != aResult.end());
+	EXPECT_EQ("345678", anEqualIt->second);
+
+	// Minimal diffs skip the heuristic
+	aResult.clear();
+	EXPECT_FALSE(detail::half_match<detail::void_traits>(aText1.begin(), aText1.end(), aText2.begin(), aText2.end(), aResult, options(true)));
+	EXPECT_TRUE(aResult.empty());
+
+	// Common range shorter than half of the longer one
+	const std::string aText3("1234567890");
+	const std::string aText4("abcdef");
+	EXPECT_FALSE(detail::half_match<detail::void_traits>(aText3.begin(), aText3.end(), aText4.begin(), aText4.end(), aResult, options()));
+	const std::string aText5("12345");
+	const std::string aText6("23");
+	EXPECT_FALSE(detail::half_match<detail::void_traits>(aText5.begin(), aText5.end(), aText6.begin(), aText6.end(), aResult, options()));
+	EXPECT_TRUE(aResult.empty());
+}
+
+TEST(algorithm, block_match)
+{
+	typedef std::list<std::pair<operation, std::string> > hunk_list;
+
+	std::string aText1;
+	unsigned long aSeed(1);
+	for(unsigned i = 0; i < 4000; ++i)
+	{
+		aSeed = aSeed * 1103515245 + 12345;
+		aText1 += static_cast<char>('a' + (aSeed >> 16) % 26);
+	}
+	std::string aText2(aText1);
+	aText2.erase(100, 30);
+	aText2.insert(2000, "inserted");
+	aText2[3500] = '#';
+
+	detail::rolling_checksum aRolled;
+	detail::rolling_checksum aChecksum;
+	aRolled.reset(aText1.begin(), 16);
+	aRolled.roll(aText1[0], aText1[16], 16);
+	aChecksum.reset(aText1.begin() + 1, 16);
+	EXPECT_EQ(aChecksum.value(), aRolled.value());
+
+	hunk_list aResult;
+	EXPECT_TRUE((detail::block_matcher<detail::void_traits, std::string::const_iterator>::calculate(aText1.begin(), aText1.end(),
+			aText2.begin(), aText2.end(), aResult, options(), 16)));
+	std::string aSide1;
+	std::string aSide2;
+	size_t anEqualSize(0);
+	for(hunk_list::const_iterator aHunkIt = aResult.begin(); aHunkIt != aResult.end(); ++aHunkIt)
+	{
+		if(!aHunkIt->first.isInsert())
+		{
+			aSide1 += aHunkIt->second;
+		}
+		if(!aHunkIt->first.isRemove())
+		{
+			aSide2 += aHunkIt->second;
+		}
+		anEqualSize += aHunkIt->first.isEqual() ? aHunkIt->second.size() : 0;
+	}
+	EXPECT_EQ(aText1, aSide1);
+	EXPECT_EQ(aText2, aSide2);
+	EXPECT_EQ(aText1.size() - 30 - 1, anEqualSize);
+
+	// No common block
+	const std::string aText3(100, 'x');
+	aResult.clear();
+	EXPECT_FALSE((detail::block_matcher<detail::void_traits, std::string::const_iterator>::calculate(aText1.begin(), aText1.end(),
+			aText3.begin(), aText3.end(), aResult, options(), 16)));
+	EXPECT_TRUE(aResult.empty());
+
+	// Small or minimal diffs skip the front end
+	EXPECT_FALSE(detail::block_match<detail::void_traits>(aText1.begin(), aText1.end(), aText2.begin(), aText2.end(), aResult, options()));
+	std::vector<unsigned char> aLarge1(detail::kBlockMatchMinSize, 1);
+	std::vector<unsigned char> aLarge2(aLarge1);
+	EXPECT_FALSE(detail::block_match<detail::void_traits>(aLarge1.begin(), aLarge1.end(), aLarge2.begin(), aLarge2.end(), aResult, options(true)));
+	EXPECT_TRUE(aResult.empty());
+}
+
+namespace
+{
+
+ptrdiff_t match_offset(const std::string& iText, const std::string& iPattern, size_t iLocation,
+		const match_options& iOptions)
+{
+	const std::string::const_iterator aFoundIt = match(iText.begin(), iText.end(), iPattern.begin(), iPattern.end(),
+			iText.begin() + iLocation, iOptions);
+	return (aFoundIt != iText.end()) ? aFoundIt - iText.begin() : -1;
+}
+
+}
+
+TEST(algorithm, match)
+{
+	const match_options aDefault(0.5, 100);
+	EXPECT_EQ(5, match_offset("abcdefghijk", "fgh", 5, aDefault));
+	EXPECT_EQ(5, match_offset("abcdefghijk", "fgh", 0, aDefault));
+	EXPECT_EQ(4, match_offset("abcdefghijk", "efxhi", 0, aDefault));
+	EXPECT_EQ(2, match_offset("abcdefghijk", "cdefxyhijk", 5, aDefault));
+	EXPECT_EQ(-1, match_offset("abcdefghijk", "bxy", 1, aDefault));
+	EXPECT_EQ(2, match_offset("123456789xx0", "3456789x0", 2, aDefault));
+	EXPECT_EQ(0, match_offset("abcdef", "xxabc", 4, aDefault));
+	EXPECT_EQ(3, match_offset("abcdef", "defyy", 4, aDefault));
+	EXPECT_EQ(0, match_offset("abcdef", "xabcdefy", 0, aDefault));
+
+	// Threshold
+	EXPECT_EQ(4, match_offset("abcdefghijk", "efxyhi", 1, match_options(0.4, 100)));
+	EXPECT_EQ(-1, match_offset("abcdefghijk", "efxyhi", 1, match_options(0.3, 100)));
+	EXPECT_EQ(1, match_offset("abcdefghijk", "bcdef", 1, match_options(0.0, 100)));
+
+	// Distance
+	EXPECT_EQ(0, match_offset("abcdexyzabcde", "abccde", 3, match_options(0.5, 10)));
+	EXPECT_EQ(8, match_offset("abcdexyzabcde", "abccde", 5, match_options(0.5, 10)));
+	EXPECT_EQ(-1, match_offset("abcdefghijklmnopqrstuvwxyz", "abcdefg", 24, match_options(0.5, 10)));
+	EXPECT_EQ(0, match_offset("abcdefghijklmnopqrstuvwxyz", "abcdxxefg", 1, match_options(0.5, 10)));
+	EXPECT_EQ(0, match_offset("abcdefghijklmnopqrstuvwxyz", "abcdefg", 24, match_options(0.5, 1000)));
+
+	// Patterns longer than a word
+	std::string aPattern;
+	for(size_t anIndex = 0; anIndex < 200; ++anIndex)
+	{
+		aPattern += static_cast<char>('a' + (anIndex * 7) % 26);
+	}
+	std::string aText(std::string(500, '-') + aPattern + std::string(300, '-'));
+	aText[520] = '#';
+	aText[610] = '#';
+	aText.erase(650, 1);
+	EXPECT_EQ(500, match_offset(aText, aPattern, 480, match_options()));
+	EXPECT_EQ(-1, match_offset(std::string(1000, '-'), aPattern, 480, match_options()));
+
+	// Elements without a byte table
+	std::vector<int> aValues(aText.begin(), aText.end());
+	std::vector<int> aSearched(aPattern.begin(), aPattern.end());
+	EXPECT_TRUE(match(aValues.begin(), aValues.end(), aSearched.begin(), aSearched.end(), aValues.begin() + 520) ==
+			aValues.begin() + 500);
+}
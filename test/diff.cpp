@@ -1,5 +1,8 @@
+#include <cstdio>
+#include <fstream>
 #include <string>
 #include <iostream>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -23,3 +26,626 @@ TEST(diff, result)
 
 	EXPECT_EQ(aDiff.size(), 3u);
 }
+
+TEST(diff, flat_result)
+{
+	std::string aText1("This is first string");
+	std::string aText2("This is second string");
+
+	result<std::string> aDiff;
+	aDiff.calculate(aText1, aText2);
+
+	flat_result<std::string> aFlatDiff(aText1, aText2);
+	aFlatDiff.calculate();
+
+	ASSERT_EQ(aFlatDiff.size(), aDiff.size());
+	result<std::string>::const_iterator aDiffIt = aDiff.begin();
+	for(flat_result<std::string>::const_iterator aFlatIt = aFlatDiff.begin(); aFlatIt != aFlatDiff.end(); ++aFlatIt, ++aDiffIt)
+	{
+		EXPECT_EQ(aFlatIt->first, aDiffIt->first);
+		EXPECT_EQ(std::string(aFlatIt->second.begin(), aFlatIt->second.end()), aDiffIt->second);
+	}
+
+	result<std::string> aCopy;
+	aCopy.assign(aFlatDiff.begin(), aFlatDiff.end());
+	EXPECT_TRUE(std::equal(aCopy.begin(), aCopy.end(), aDiff.begin()));
+	EXPECT_TRUE(aFlatDiff.to_list() == flat_result<std::string>::list_type(aDiff.begin(), aDiff.end()));
+}
+
+namespace {
+
+struct text_visitor
+{
+	void on_equal(std::string::const_iterator iBegin, std::string::const_iterator iEnd)
+	{
+		_text1.append(iBegin, iEnd);
+		_text2.append(iBegin, iEnd);
+		_operations.push_back('=');
+	}
+
+	void on_remove(std::string::const_iterator iBegin, std::string::const_iterator iEnd)
+	{
+		_text1.append(iBegin, iEnd);
+		_operations.push_back('-');
+	}
+
+	void on_insert(std::string::const_iterator iBegin, std::string::const_iterator iEnd)
+	{
+		_text2.append(iBegin, iEnd);
+		_operations.push_back('+');
+	}
+
+	std::string _text1;
+	std::string _text2;
+	std::string _operations;
+};
+
+}  // namespace
+
+TEST(diff, compute)
+{
+	std::string aText1("This is first string");
+	std::string aText2("This is second string");
+
+	text_visitor aVisitor;
+	compute(aText1, aText2, aVisitor);
+	EXPECT_EQ(aVisitor._text1, aText1);
+	EXPECT_EQ(aVisitor._text2, aText2);
+	EXPECT_EQ(aVisitor._operations.find("++"), std::string::npos);
+	EXPECT_EQ(aVisitor._operations.find("=="), std::string::npos);
+
+	// Line mode
+	std::string aLines1;
+	std::string aLines2;
+	for(int i = 0; i < 200; ++i)
+	{
+		const std::string aLine(i % 7 ? "common line of text\n" : "line changed in first\n");
+		aLines1 += aLine;
+		aLines2 += (i % 7 ? aLine : std::string("line changed in second\n"));
+	}
+	text_visitor aLineVisitor;
+	compute(aLines1, aLines2, aLineVisitor);
+	EXPECT_EQ(aLineVisitor._text1, aLines1);
+	EXPECT_EQ(aLineVisitor._text2, aLines2);
+}
+
+TEST(diff, release)
+{
+	std::string aText1("This is first string");
+	std::string aText2("This is second string");
+
+	result<std::string> aDiff;
+	aDiff.calculate(aText1, aText2);
+	const size_t aSize = aDiff.size();
+
+	result<std::string>::container_type aHunks = aDiff.release();
+	EXPECT_TRUE(aDiff.empty());
+	EXPECT_EQ(aHunks.size(), aSize);
+
+	flat_result<std::string> aFlatDiff;
+	std::string aCopy1(aText1);
+	std::string aCopy2(aText2);
+	aFlatDiff.adopt(aCopy1, aCopy2);
+	aFlatDiff.calculate();
+	EXPECT_TRUE(aCopy1.empty());
+	EXPECT_TRUE(aCopy2.empty());
+
+	const flat_result<std::string> aFlatCopy(aFlatDiff);
+	std::string aRebuilt;
+	for(flat_result<std::string>::const_iterator aFlatIt = aFlatCopy.begin(); aFlatIt != aFlatCopy.end(); ++aFlatIt)
+	{
+		if(!aFlatIt->first.isRemove())
+		{
+			aRebuilt.append(aFlatIt->second.begin(), aFlatIt->second.end());
+		}
+	}
+	EXPECT_EQ(aRebuilt, aText2);
+
+	// Short owned strings keep their elements inline, views follow them
+	std::string aShort1("abc");
+	std::string aShort2("abd");
+	flat_result<std::string> aShortDiff;
+	aShortDiff.adopt(aShort1, aShort2);
+	aShortDiff.calculate();
+	flat_result<std::string> aSwapped;
+	aSwapped.swap(aShortDiff);
+	EXPECT_TRUE(aShortDiff.empty());
+	ASSERT_EQ(3U, aSwapped.size());
+	EXPECT_EQ("ab", std::string(aSwapped[0].second.begin(), aSwapped[0].second.end()));
+	EXPECT_EQ("d", std::string(aSwapped[2].second.begin(), aSwapped[2].second.end()));
+
+#if __cplusplus >= 201103L
+	flat_result<std::string> aMoved(std::move(aSwapped));
+	EXPECT_TRUE(aSwapped.empty());
+	ASSERT_EQ(3U, aMoved.size());
+	EXPECT_EQ("c", std::string(aMoved[1].second.begin(), aMoved[1].second.end()));
+	aSwapped = std::move(aMoved);
+	EXPECT_TRUE(aMoved.empty());
+	ASSERT_EQ(3U, aSwapped.size());
+	EXPECT_EQ("ab", std::string(aSwapped[0].second.begin(), aSwapped[0].second.end()));
+#endif
+}
+
+namespace {
+
+//! Statistics of the hunks walked from scratch equal the kept ones.
+template<typename Result>
+bool stats_follow(const Result& iDiff)
+{
+	stats aStats;
+	for(typename Result::const_iterator aResultIt = iDiff.begin(); aResultIt != iDiff.end(); ++aResultIt)
+	{
+		aStats.add(aResultIt->first, aResultIt->second.size());
+	}
+	const stats& aKept = iDiff.stats();
+	return (aStats.equal() == aKept.equal()) && (aStats.inserted() == aKept.inserted()) &&
+			(aStats.removed() == aKept.removed()) && (aStats.equal_hunks() == aKept.equal_hunks()) &&
+			(aStats.insert_hunks() == aKept.insert_hunks()) && (aStats.remove_hunks() == aKept.remove_hunks()) &&
+			(aStats.distance() == aKept.distance());
+}
+
+}  // namespace
+
+TEST(diff, stats)
+{
+	std::string aText1("The quick brown fox jumps over the lazy dog");
+	std::string aText2("The quick red fox jumped over the lazy dogs");
+
+	result<std::string> aDiff;
+	aDiff.calculate(aText1, aText2);
+
+	const stats& aStats = aDiff.stats();
+	EXPECT_EQ(aStats.hunks(), aDiff.size());
+	EXPECT_EQ(aStats.equal() + aStats.removed(), aText1.size());
+	EXPECT_EQ(aStats.equal() + aStats.inserted(), aText2.size());
+	EXPECT_GE(aStats.distance(), std::max(aStats.inserted(), aStats.removed()));
+	EXPECT_LE(aStats.distance(), aStats.inserted() + aStats.removed());
+	EXPECT_GT(aStats.similarity(), 0.5);
+	EXPECT_LT(aStats.similarity(), 1.0);
+
+	flat_result<std::string> aFlatDiff(aText1, aText2);
+	aFlatDiff.calculate();
+	EXPECT_EQ(aFlatDiff.stats().hunks(), aFlatDiff.size());
+	EXPECT_EQ(aFlatDiff.stats().equal(), aStats.equal());
+
+	stats aStreamed;
+	compute(aText1, aText2, aStreamed);
+	EXPECT_EQ(aStreamed.distance(), aFlatDiff.stats().distance());
+
+	stats anIdentical;
+	compute(aText1, aText1, anIdentical);
+	EXPECT_EQ(anIdentical.distance(), 0u);
+	EXPECT_EQ(anIdentical.similarity(), 1.0);
+
+	// Operations reshaping the hunks keep the statistics up to date
+	EXPECT_TRUE(stats_follow(aDiff));
+	result<std::string> aCleaned(aDiff);
+	aCleaned.cleanup();
+	EXPECT_TRUE(stats_follow(aCleaned));
+	aCleaned = aDiff;
+	aCleaned.cleanup(sequential_executor(), 2);
+	EXPECT_TRUE(stats_follow(aCleaned));
+	aCleaned.cleanup_efficiency();
+	EXPECT_TRUE(stats_follow(aCleaned));
+	aCleaned.invert();
+	EXPECT_TRUE(stats_follow(aCleaned));
+	aCleaned.compose(aDiff, aCleaned);
+	EXPECT_TRUE(stats_follow(aCleaned));
+	aCleaned.assign(aFlatDiff.begin(), aFlatDiff.end());
+	EXPECT_TRUE(stats_follow(aCleaned));
+}
+
+namespace {
+
+//! Allocations made through any counting_allocator and elements still allocated.
+size_t gAllocations(0);
+size_t gLive(0);
+
+template<typename T>
+class counting_allocator: public std::allocator<T>
+{
+public:
+	template<typename U>
+	struct rebind
+	{
+		typedef counting_allocator<U> other;
+	};
+
+	typedef T value_type;
+	typedef T* pointer;
+	typedef size_t size_type;
+
+	counting_allocator() {}
+
+	template<typename U>
+	counting_allocator(const counting_allocator<U>& iOther): std::allocator<T>(iOther) {}
+
+	pointer allocate(size_type iSize, const void* = 0)
+	{
+		++gAllocations;
+		gLive += iSize;
+		return std::allocator<T>::allocate(iSize);
+	}
+
+	void deallocate(pointer iPointer, size_type iSize)
+	{
+		gLive -= iSize;
+		std::allocator<T>::deallocate(iPointer, iSize);
+	}
+};
+
+}  // namespace
+
+TEST(diff, allocator)
+{
+	typedef std::basic_string<char, std::char_traits<char>, counting_allocator<char> > string_type;
+	typedef result<string_type, detail::range_traits<string_type>,
+			counting_allocator<std::pair<operation, string_type> > > result_type;
+
+	gAllocations = 0;
+	gLive = 0;
+	{
+		string_type aText1;
+		string_type aText2;
+		for(size_t i = 0; i < 100; ++i)
+		{
+			aText1 += "A line of text.\n";
+			aText1 += (i % 4) ? "The cat came back.\n" : "The dog ran away.\n";
+			aText2 += "A line of text.\n";
+			aText2 += (i % 4) ? "The cat came back again.\n" : "The dog ran far away.\n";
+		}
+		const size_t aTextAllocations = gAllocations;
+
+		result_type aDiff;
+		aDiff.calculate(aText1, aText2);
+		EXPECT_GT(gAllocations, aTextAllocations + aDiff.size());
+		aDiff.cleanup();
+		aDiff.cleanup(sequential_executor(), 16);
+		aDiff.cleanup_efficiency();
+
+		string_type aCheck1;
+		string_type aCheck2;
+		for(result_type::const_iterator aResultIt = aDiff.begin(); aResultIt != aDiff.end(); ++aResultIt)
+		{
+			aCheck1 += aResultIt->first.isInsert() ? string_type() : aResultIt->second;
+			aCheck2 += aResultIt->first.isRemove() ? string_type() : aResultIt->second;
+		}
+		EXPECT_TRUE(aCheck1 == aText1);
+		EXPECT_TRUE(aCheck2 == aText2);
+	}
+	EXPECT_EQ(gLive, 0u);
+}
+
+TEST(diff, segmented_cleanup)
+{
+	std::string aText1;
+	std::string aText2;
+	for(size_t i = 0; i < 300; ++i)
+	{
+		const std::string aParagraph("A paragraph of text long enough to split the hunks into segments.\n");
+		aText1 += aParagraph + (i % 3 ? "The cat came back.\n" : "The dog ran away.\n");
+		aText2 += aParagraph + (i % 3 ? "The cat came back again.\n" : "The dog ran far away.\n");
+	}
+
+	result<std::string> aDiff;
+	aDiff.calculate(aText1, aText2);
+	result<std::string> aSegmented(aDiff);
+	aDiff.cleanup();
+	aSegmented.cleanup(sequential_executor());
+	EXPECT_TRUE(std::equal(aDiff.begin(), aDiff.end(), aSegmented.begin()));
+	EXPECT_EQ(aDiff.size(), aSegmented.size());
+
+#if __cplusplus >= 201103L
+	result<std::string> aThreaded;
+	aThreaded.calculate(aText1, aText2);
+	aThreaded.cleanup(thread_executor(4), 16);
+	std::string aCheck1;
+	std::string aCheck2;
+	for(result<std::string>::const_iterator aResultIt = aThreaded.begin(); aResultIt != aThreaded.end(); ++aResultIt)
+	{
+		aCheck1 += aResultIt->first.isInsert() ? "" : aResultIt->second;
+		aCheck2 += aResultIt->first.isRemove() ? "" : aResultIt->second;
+	}
+	EXPECT_EQ(aText1, aCheck1);
+	EXPECT_EQ(aText2, aCheck2);
+#endif
+}
+
+TEST(diff, chunked)
+{
+	typedef std::vector<unsigned char> bytes;
+	typedef result<bytes> result_type;
+
+	bytes aData1(1 << 20);
+	unsigned long aSeed(7);
+	for(size_t i = 0; i < aData1.size(); ++i)
+	{
+		aSeed = aSeed * 1103515245 + 12345;
+		aData1[i] = static_cast<unsigned char>(aSeed >> 16);
+	}
+	bytes aData2(aData1);
+	aData2.erase(aData2.begin() + 100000, aData2.begin() + 100100);
+	aData2.insert(aData2.begin() + 500000, 64, 0xAB);
+	aData2[900000] ^= 1;
+
+	result_type aDiff;
+	aDiff.calculate(aData1, aData2, sequential_executor());
+	EXPECT_EQ(aDiff.stats().removed(), 101u);
+	EXPECT_EQ(aDiff.stats().inserted(), 65u);
+
+#if __cplusplus >= 201103L
+	result_type aThreaded;
+	aThreaded.calculate(aData1, aData2, thread_executor(4));
+	EXPECT_TRUE(std::equal(aDiff.begin(), aDiff.end(), aThreaded.begin()));
+	EXPECT_EQ(aDiff.size(), aThreaded.size());
+#endif
+
+	bytes aCheck1;
+	bytes aCheck2;
+	for(result_type::const_iterator aResultIt = aDiff.begin(); aResultIt != aDiff.end(); ++aResultIt)
+	{
+		if(!aResultIt->first.isInsert())
+		{
+			aCheck1.insert(aCheck1.end(), aResultIt->second.begin(), aResultIt->second.end());
+		}
+		if(!aResultIt->first.isRemove())
+		{
+			aCheck2.insert(aCheck2.end(), aResultIt->second.begin(), aResultIt->second.end());
+		}
+	}
+	EXPECT_TRUE(aCheck1 == aData1);
+	EXPECT_TRUE(aCheck2 == aData2);
+
+	// Short ranges are diffed as usual
+	const std::string aText1("This is first string");
+	const std::string aText2("This is second string");
+	result<std::string> aShort;
+	aShort.calculate(aText1, aText2, sequential_executor());
+	result<std::string> anUsual;
+	anUsual.calculate(aText1, aText2);
+	EXPECT_TRUE(std::equal(aShort.begin(), aShort.end(), anUsual.begin()));
+}
+
+TEST(diff, make_patches)
+{
+	std::string aText1("The quick brown fox jumps over the lazy dog, then naps under the old oak tree.");
+	std::string aText2("The quick red fox jumps over the lazy dog, then naps under the old elm tree!");
+
+	result<std::string> aDiff;
+	aDiff.calculate(aText1, aText2);
+	aDiff.cleanup();
+	std::vector<result<std::string>::patch_type> aPatches;
+	aDiff.make_patches(aPatches);
+	ASSERT_EQ(2U, aPatches.size());
+
+	// Patches cover the same parts of both texts as their hunks
+	for(size_t i = 0; i < aPatches.size(); ++i)
+	{
+		const result<std::string>::patch_type& aPatch = aPatches[i];
+		std::string aPart1(aPatch._prefix.begin(), aPatch._prefix.end());
+		std::string aPart2(aPart1);
+		for(result<std::string>::const_iterator aHunkIt = aPatch._begin; aHunkIt != aPatch._end; ++aHunkIt)
+		{
+			aPart1 += aHunkIt->first.isInsert() ? "" : aHunkIt->second;
+			aPart2 += aHunkIt->first.isRemove() ? "" : aHunkIt->second;
+		}
+		aPart1.append(aPatch._suffix.begin(), aPatch._suffix.end());
+		aPart2.append(aPatch._suffix.begin(), aPatch._suffix.end());
+		EXPECT_EQ(aText1.substr(aPatch._start1, aPatch._length1), aPart1);
+		EXPECT_EQ(aText2.substr(aPatch._start2, aPatch._length2), aPart2);
+	}
+	EXPECT_EQ("ick brown fox", aText1.substr(aPatches[0]._start1, aPatches[0]._length1));
+	EXPECT_EQ("ick red fox", aText2.substr(aPatches[0]._start2, aPatches[0]._length2));
+	EXPECT_TRUE(aPatches[1]._suffix.empty());
+	EXPECT_EQ(aText1.size(), aPatches[1]._start1 + aPatches[1]._length1);
+
+	// Edits closer than twice the margin end up in one patch
+	aPatches.clear();
+	aDiff.make_patches(aPatches, 40);
+	EXPECT_EQ(1U, aPatches.size());
+
+	flat_result<std::string> aFlatDiff(aText1, aText2);
+	aFlatDiff.calculate();
+	std::vector<flat_result<std::string>::patch_type> aFlatPatches;
+	aFlatDiff.make_patches(aFlatPatches);
+	EXPECT_FALSE(aFlatPatches.empty());
+	EXPECT_EQ(aFlatPatches.back()._start2 + aFlatPatches.back()._length2, aText2.size());
+}
+
+TEST(diff, apply_patches)
+{
+	const std::string aText1("The quick brown fox jumps over the lazy dog, then naps under the old oak tree.");
+	const std::string aText2("The quick red fox jumps over the lazy dog, then naps under the old elm tree!");
+
+	result<std::string> aDiff;
+	aDiff.calculate(aText1, aText2);
+	aDiff.cleanup();
+	std::vector<result<std::string>::patch_type> aPatches;
+	aDiff.make_patches(aPatches);
+
+	std::string aText;
+	std::vector<bool> anApplied;
+	EXPECT_TRUE(apply(aPatches, aText1, aText, anApplied));
+	EXPECT_EQ(aText2, aText);
+	EXPECT_EQ(aPatches.size(), anApplied.size());
+
+	// Moved and slightly changed context is found fuzzily
+	EXPECT_TRUE(apply(aPatches, std::string("Note: the quick brown fax jumps over the lazy dog, then naps under the old oak tree."), aText, anApplied));
+	EXPECT_EQ("Note: the quick red fax jumps over the lazy dog, then naps under the old elm tree!", aText);
+
+	// Patches without their context are skipped
+	EXPECT_FALSE(apply(aPatches, std::string("The quick brown fox jumps over the lazy cat."), aText, anApplied));
+	ASSERT_EQ(2U, anApplied.size());
+	EXPECT_TRUE(anApplied[0]);
+	EXPECT_FALSE(anApplied[1]);
+	EXPECT_EQ("The quick red fox jumps over the lazy cat.", aText);
+
+	flat_result<std::string> aFlatDiff(aText1, aText2);
+	aFlatDiff.calculate();
+	std::vector<flat_result<std::string>::patch_type> aFlatPatches;
+	aFlatDiff.make_patches(aFlatPatches);
+	EXPECT_TRUE(apply(aFlatPatches, aText1, aText, anApplied));
+	EXPECT_EQ(aText2, aText);
+}
+
+TEST(diff, merge3)
+{
+	typedef std::vector<merge_conflict<std::string::const_iterator> > conflict_vector;
+
+	const std::string aBase("one\ntwo\nthree\nfour\nfive\nsix\n");
+	std::string aMerged;
+	conflict_vector aConflicts;
+	EXPECT_TRUE(merge3(aBase, std::string("one\n2\nthree\nfour\nfive\nsix\n"),
+			std::string("one\ntwo\nthree\nfour\n5\nsix\nseven\n"), aMerged, aConflicts));
+	EXPECT_EQ("one\n2\nthree\nfour\n5\nsix\nseven\n", aMerged);
+	EXPECT_TRUE(aConflicts.empty());
+
+	// Same change on both sides
+	aMerged.clear();
+	EXPECT_TRUE(merge3(aBase, std::string("one\ntwo\n3\nfour\nfive\nsix\n"),
+			std::string("zero\none\ntwo\n3\nfour\nfive\nsix\n"), aMerged, aConflicts));
+	EXPECT_EQ("zero\none\ntwo\n3\nfour\nfive\nsix\n", aMerged);
+
+	// Different changes of the same lines
+	const std::string aOurs("one\ntwo\nTHREE\nfour\nfive\n");
+	const std::string aTheirs("one\ntwo\n3\nfour\nfive\nsix\n");
+	aMerged.clear();
+	EXPECT_FALSE(merge3(aBase, aOurs, aTheirs, aMerged, aConflicts));
+	EXPECT_EQ(aOurs, aMerged);
+	ASSERT_EQ(1U, aConflicts.size());
+	EXPECT_EQ(8U, aConflicts[0]._offset);
+	EXPECT_EQ("three\n", std::string(aConflicts[0]._base.begin(), aConflicts[0]._base.end()));
+	EXPECT_EQ("THREE\n", std::string(aConflicts[0]._ours.begin(), aConflicts[0]._ours.end()));
+	EXPECT_EQ("3\n", std::string(aConflicts[0]._theirs.begin(), aConflicts[0]._theirs.end()));
+
+	// Elements without line traits
+	int aBaseValues[] = {1, 2, 3, 4, 5, 6, 7, 8};
+	int anOursValues[] = {1, 2, 30, 4, 5, 6, 7, 8};
+	int aTheirsValues[] = {1, 2, 3, 4, 5, 7, 8, 9};
+	int aMergedValues[] = {1, 2, 30, 4, 5, 7, 8, 9};
+	std::vector<int> aValues;
+	std::vector<merge_conflict<std::vector<int>::const_iterator> > aValueConflicts;
+	EXPECT_TRUE(merge3(std::vector<int>(aBaseValues, aBaseValues + 8), std::vector<int>(anOursValues, anOursValues + 8),
+			std::vector<int>(aTheirsValues, aTheirsValues + 8), aValues, aValueConflicts));
+	EXPECT_TRUE(aValues == std::vector<int>(aMergedValues, aMergedValues + 8));
+
+#if __cplusplus >= 201103L
+	std::string aThreaded;
+	aConflicts.clear();
+	EXPECT_FALSE(merge3(aBase, aOurs, aTheirs, aThreaded, aConflicts, thread_executor(2)));
+	EXPECT_EQ(aMerged, aThreaded);
+	EXPECT_EQ(1U, aConflicts.size());
+#endif
+}
+
+TEST(diff, compose)
+{
+	const std::string aText1("The quick brown fox jumps over the lazy dog.");
+	const std::string aText2("The quick red fox jumps over the dog!");
+	const std::string aText3("A quick red fox leaps over the dog!");
+
+	result<std::string> aDiff1;
+	result<std::string> aDiff2;
+	aDiff1.calculate(aText1, aText2);
+	aDiff2.calculate(aText2, aText3);
+	result<std::string> aComposed;
+	EXPECT_TRUE(aComposed.compose(aDiff1, aDiff2));
+
+	std::string aCheck1;
+	std::string aCheck3;
+	for(result<std::string>::const_iterator aResultIt = aComposed.begin(); aResultIt != aComposed.end(); ++aResultIt)
+	{
+		aCheck1 += aResultIt->first.isInsert() ? "" : aResultIt->second;
+		aCheck3 += aResultIt->first.isRemove() ? "" : aResultIt->second;
+	}
+	EXPECT_EQ(aText1, aCheck1);
+	EXPECT_EQ(aText3, aCheck3);
+
+	// A diff composed with its inverse keeps everything
+	result<std::string> anInverse(aDiff1);
+	anInverse.invert();
+	aComposed.compose(aDiff1, anInverse);
+	ASSERT_EQ(1U, aComposed.size());
+	EXPECT_TRUE(aComposed.begin()->first.isEqual());
+	EXPECT_EQ(aText1, aComposed.begin()->second);
+
+	anInverse.invert();
+	EXPECT_TRUE(anInverse.begin() != anInverse.end());
+	EXPECT_EQ(aDiff1.stats().distance(), anInverse.stats().distance());
+
+	// Diffs of Bs of different lengths are rejected
+	const size_t aComposedSize = aComposed.size();
+	EXPECT_FALSE(aComposed.compose(aDiff1, aDiff1));
+	EXPECT_EQ(aComposedSize, aComposed.size());
+
+	flat_result<std::string> aFlat1(aText1, aText2);
+	flat_result<std::string> aFlat2(aText2, aText3);
+	aFlat1.calculate();
+	aFlat2.calculate();
+	flat_result<std::string> aFlatComposed;
+	EXPECT_TRUE(aFlatComposed.compose(aFlat1, aFlat2));
+	aCheck1.clear();
+	aCheck3.clear();
+	for(flat_result<std::string>::const_iterator aResultIt = aFlatComposed.begin(); aResultIt != aFlatComposed.end(); ++aResultIt)
+	{
+		const flat_result<std::string>::value_type aHunk(*aResultIt);
+		(aHunk.first.isInsert() ? aCheck3 : aCheck1).append(aHunk.second.begin(), aHunk.second.end());
+		if(aHunk.first.isEqual())
+		{
+			aCheck3.append(aHunk.second.begin(), aHunk.second.end());
+		}
+	}
+	EXPECT_EQ(aText1, aCheck1);
+	EXPECT_EQ(aText3, aCheck3);
+
+	flat_result<std::string> aFlatInverse(aFlat1);
+	aFlatInverse.invert();
+	aFlatComposed.compose(aFlat1, aFlatInverse);
+	ASSERT_EQ(1U, aFlatComposed.size());
+	EXPECT_TRUE(aFlatComposed[0].first.isEqual());
+	EXPECT_FALSE(aFlatComposed.compose(aFlat1, aFlat1));
+	EXPECT_EQ(1U, aFlatComposed.size());
+}
+
+TEST(diff, diff_files)
+{
+	const std::string aText1("one\ntwo\nthree\nfour\n");
+	const std::string aText2("one\n2\nthree\nfour\nfive\n");
+	const std::string aPath1("izi_diff_test_1.txt");
+	const std::string aPath2("izi_diff_test_2.txt");
+	{
+		std::ofstream aFile1(aPath1.c_str(), std::ios::binary);
+		std::ofstream aFile2(aPath2.c_str(), std::ios::binary);
+		aFile1 << aText1;
+		aFile2 << aText2;
+	}
+
+	file_diff aDiff;
+	ASSERT_TRUE(diff_files(aPath1, aPath2, aDiff));
+	EXPECT_EQ(aDiff.file1().size(), aText1.size());
+	EXPECT_EQ(aDiff.file2().size(), aText2.size());
+
+	flat_result<std::string> anExpected(aText1, aText2);
+	anExpected.calculate();
+	ASSERT_EQ(aDiff.script().size(), anExpected.size());
+	flat_result<std::string>::const_iterator anExpectedIt = anExpected.begin();
+	for(file_diff::script_type::const_iterator aHunkIt = aDiff.script().begin(); aHunkIt != aDiff.script().end();
+			++aHunkIt, ++anExpectedIt)
+	{
+		EXPECT_EQ(aHunkIt->first, anExpectedIt->first);
+		EXPECT_EQ(std::string(aHunkIt->second.begin(), aHunkIt->second.end()),
+				std::string(anExpectedIt->second.begin(), anExpectedIt->second.end()));
+	}
+
+	// Empty file, missing file
+	{
+		std::ofstream aFile2(aPath2.c_str(), std::ios::binary | std::ios::trunc);
+	}
+	ASSERT_TRUE(diff_files(aPath1, aPath2, aDiff));
+	EXPECT_EQ(aDiff.script().stats().removed(), aText1.size());
+	EXPECT_FALSE(diff_files(aPath1, "izi_diff_missing.txt", aDiff));
+	EXPECT_TRUE(aDiff.script().empty());
+
+	std::remove(aPath1.c_str());
+	std::remove(aPath2.c_str());
+}
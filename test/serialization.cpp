@@ -0,0 +1,264 @@
+#include <list>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <diff.h>
+
+using namespace izi::diff;
+
+
+TEST(serialization, varint)
+{
+	std::string aBuffer;
+	detail::write_varint(0, std::back_inserter(aBuffer));
+	detail::write_varint(127, std::back_inserter(aBuffer));
+	detail::write_varint(128, std::back_inserter(aBuffer));
+	detail::write_varint(300000, std::back_inserter(aBuffer));
+	EXPECT_EQ(aBuffer.size(), 1u + 1u + 2u + 3u);
+
+	const std::string& aConstBuffer(aBuffer);
+	std::string::const_iterator anIt = aConstBuffer.begin();
+	size_t aValue;
+	EXPECT_TRUE(detail::read_varint(anIt, aConstBuffer.end(), aValue));
+	EXPECT_EQ(aValue, 0u);
+	EXPECT_TRUE(detail::read_varint(anIt, aConstBuffer.end(), aValue));
+	EXPECT_EQ(aValue, 127u);
+	EXPECT_TRUE(detail::read_varint(anIt, aConstBuffer.end(), aValue));
+	EXPECT_EQ(aValue, 128u);
+	EXPECT_TRUE(detail::read_varint(anIt, aConstBuffer.end(), aValue));
+	EXPECT_EQ(aValue, 300000u);
+	EXPECT_FALSE(detail::read_varint(anIt, aConstBuffer.end(), aValue));
+}
+
+TEST(serialization, round_trip)
+{
+	std::string aText1("The quick brown fox jumps over the lazy dog");
+	std::string aText2("The quick red fox jumped over the lazy dogs");
+
+	result<std::string> aDiff;
+	aDiff.calculate(aText1, aText2);
+
+	std::string aDelta;
+	encode(aDiff, std::back_inserter(aDelta));
+	EXPECT_EQ(aDelta.size(), encoded_size(aDiff));
+	EXPECT_LT(aDelta.size(), aText2.size());
+
+	std::string aTarget;
+	EXPECT_TRUE(decode(aText1, aDelta.begin(), aDelta.end(), aTarget));
+	EXPECT_EQ(aTarget, aText2);
+
+	// Streaming encoder produces a script decodable the same way
+	std::string aStreamed;
+	encoder<std::back_insert_iterator<std::string> > anEncoder(std::back_inserter(aStreamed));
+	compute(aText1, aText2, anEncoder);
+	aTarget.clear();
+	EXPECT_TRUE(decode(aText1, aStreamed.begin(), aStreamed.end(), aTarget));
+	EXPECT_EQ(aTarget, aText2);
+
+	std::list<std::pair<operation, range<std::string::const_iterator> > > aHunks;
+	const std::string& aBase(aText1);
+	const std::string& aConstDelta(aDelta);
+	EXPECT_TRUE(decode_hunks(aBase.begin(), aBase.end(), aConstDelta.begin(), aConstDelta.end(), aHunks));
+	EXPECT_EQ(aHunks.size(), aDiff.size());
+
+	// Base of a different length or a truncated script is rejected
+	aTarget.clear();
+	EXPECT_FALSE(decode(aText1 + "!", aDelta.begin(), aDelta.end(), aTarget));
+	EXPECT_FALSE(decode(aText1, aDelta.begin(), aDelta.end() - 1, aTarget));
+}
+
+TEST(serialization, wide)
+{
+	std::wstring aText1(L"wide \x263A text");
+	std::wstring aText2(L"wider \x263B text");
+
+	result<std::wstring> aDiff;
+	aDiff.calculate(aText1, aText2);
+
+	std::string aDelta;
+	encode(aDiff, std::back_inserter(aDelta));
+
+	std::wstring aTarget;
+	EXPECT_TRUE(decode(aText1, aDelta.begin(), aDelta.end(), aTarget));
+	EXPECT_TRUE(aTarget == aText2);
+}
+
+TEST(serialization, mapped)
+{
+	std::string aText1("The quick brown fox jumps over the lazy dog");
+	std::string aText2("The quick red fox jumped over the lazy dogs");
+
+	flat_result<std::string> aDiff(aText1, aText2);
+	aDiff.calculate();
+
+	// Aligned buffer standing in for a mapped file
+	std::vector<double> aStorage(mapped_size(aDiff) / sizeof(double) + 1);
+	char* aBuffer = reinterpret_cast<char*>(&aStorage[0]);
+	char* aBufferEnd = write_mapped(aDiff, aBuffer);
+	EXPECT_EQ(static_cast<size_t>(aBufferEnd - aBuffer), mapped_size(aDiff));
+
+	mapped_script<char> aScript(aBuffer, aBufferEnd - aBuffer);
+	ASSERT_TRUE(aScript.valid());
+	ASSERT_EQ(aScript.size(), aDiff.size());
+	EXPECT_EQ(aScript.old_size(), aText1.size());
+	EXPECT_EQ(aScript.new_size(), aText2.size());
+
+	std::string aTarget;
+	for(size_t i = 0; i < aScript.size(); ++i)
+	{
+		const mapped_hunk<char> aHunk(aScript[i]);
+		EXPECT_EQ(aHunk._operation, aDiff.hunks()[i]._operation);
+		if(aHunk._operation.isEqual())
+		{
+			aTarget.append(aText1, aHunk._pos1, aHunk._length);
+		}
+		else if(aHunk._operation.isInsert())
+		{
+			ASSERT_TRUE(aHunk._payload != 0);
+			aTarget.append(aHunk._payload, aHunk._length);
+		}
+	}
+	EXPECT_EQ(aTarget, aText2);
+
+	for(size_t aPos = 0; aPos < aText1.size(); ++aPos)
+	{
+		const mapped_hunk<char> aHunk(aScript[aScript.find_old(aPos)]);
+		EXPECT_FALSE(aHunk._operation.isInsert());
+		EXPECT_LE(aHunk._pos1, aPos);
+		EXPECT_GT(aHunk._pos1 + aHunk._length, aPos);
+	}
+	for(size_t aPos = 0; aPos < aText2.size(); ++aPos)
+	{
+		const mapped_hunk<char> aHunk(aScript[aScript.find_new(aPos)]);
+		EXPECT_FALSE(aHunk._operation.isRemove());
+		EXPECT_LE(aHunk._pos2, aPos);
+		EXPECT_GT(aHunk._pos2 + aHunk._length, aPos);
+	}
+	EXPECT_EQ(aScript.find_old(aText1.size()), aScript.size());
+
+	EXPECT_FALSE(mapped_script<char>(aBuffer, 16).valid());
+}
+
+TEST(serialization, unified)
+{
+	std::string aText1("a\nb\nc\nd\ne\nf\ng\nh\ni\nj\n");
+	std::string aText2("a\nb\nC\nd\ne\nf\ng\nh\ni\nJ\nk");
+
+	result<std::string> aDiff;
+	aDiff.calculate(aText1, aText2);
+
+	std::ostringstream aNarrow;
+	write_unified(aDiff, aNarrow, "old", "new", 1);
+	EXPECT_EQ(aNarrow.str(),
+			"--- old\n+++ new\n"
+			"@@ -2,3 +2,3 @@\n b\n-c\n+C\n d\n"
+			"@@ -9,2 +9,3 @@\n i\n-j\n+J\n+k\n\\ No newline at end of file\n");
+
+	std::ostringstream aWide;
+	write_unified(aDiff, aWide, "old", "new");
+	EXPECT_EQ(aWide.str(),
+			"--- old\n+++ new\n"
+			"@@ -1,10 +1,11 @@\n a\n b\n-c\n+C\n d\n e\n f\n g\n h\n i\n-j\n+J\n+k\n\\ No newline at end of file\n");
+
+	// Streamed from the calculation, same output
+	std::ostringstream aStreamed;
+	unified_writer<std::ostringstream, std::string::const_iterator> aWriter(aStreamed, "old", "new", 1);
+	compute(aText1, aText2, aWriter);
+	aWriter.flush();
+	EXPECT_EQ(aStreamed.str(), aNarrow.str());
+
+	flat_result<std::string> aFlat(aText1, aText2);
+	aFlat.calculate();
+	std::ostringstream aFromFlat;
+	write_unified(aFlat, aFromFlat, "old", "new", 1);
+	EXPECT_EQ(aFromFlat.str(), aNarrow.str());
+
+	// Whole lines removed and inserted, the lines after them are context
+	result<std::string> aLineRemoval;
+	aLineRemoval.calculate(std::string("a\nb\nc\n"), std::string("a\nc\n"));
+	std::ostringstream aRemoved;
+	write_unified(aLineRemoval, aRemoved, "a", "b");
+	EXPECT_EQ(aRemoved.str(), "--- a\n+++ b\n@@ -1,3 +1,2 @@\n a\n-b\n c\n");
+
+	result<std::string> aFirstRemoval;
+	aFirstRemoval.calculate(std::string("a\nb\n"), std::string("b\n"));
+	std::ostringstream aFirstRemoved;
+	write_unified(aFirstRemoval, aFirstRemoved, "a", "b");
+	EXPECT_EQ(aFirstRemoved.str(), "--- a\n+++ b\n@@ -1,2 +1 @@\n-a\n b\n");
+
+	result<std::string> aLineInsertion;
+	aLineInsertion.calculate(std::string("a\nc\n"), std::string("a\nb\nc\nd\n"));
+	std::ostringstream anInserted;
+	write_unified(aLineInsertion, anInserted, "a", "b");
+	EXPECT_EQ(anInserted.str(), "--- a\n+++ b\n@@ -1,2 +1,4 @@\n a\n+b\n c\n+d\n");
+
+	result<std::string> anAddition;
+	anAddition.calculate(std::string(), std::string("x\n"));
+	std::ostringstream anAdded;
+	write_unified(anAddition, anAdded, "a", "b");
+	EXPECT_EQ(anAdded.str(), "--- a\n+++ b\n@@ -0,0 +1 @@\n+x\n");
+
+	result<std::string> anIdentity;
+	anIdentity.calculate(aText1, aText1);
+	std::ostringstream aSame;
+	write_unified(anIdentity, aSame, "a", "b");
+	EXPECT_TRUE(aSame.str().empty());
+}
+
+TEST(serialization, delta)
+{
+	std::vector<unsigned char> aSource;
+	for(unsigned i = 0; i < 1000; ++i)
+	{
+		aSource.push_back(static_cast<unsigned char>(i * 7 + i / 13));
+	}
+	std::vector<unsigned char> aTarget(aSource);
+	aTarget.erase(aTarget.begin() + 100, aTarget.begin() + 150);
+	aTarget.insert(aTarget.begin() + 500, 20, 0xFF);
+	aTarget[900] = 0;
+
+	std::string aDelta;
+	encode_delta(aSource, aTarget, std::back_inserter(aDelta));
+	EXPECT_LT(aDelta.size(), 64u);
+
+	std::vector<unsigned char> aDecoded;
+	EXPECT_TRUE(apply_delta(aSource, aDelta.begin(), aDelta.end(), aDecoded));
+	EXPECT_EQ(aDecoded, aTarget);
+
+	// Byte views and streamed input
+	typedef range<const unsigned char*> view_type;
+	const view_type aSourceView(&aSource[0], &aSource[0] + aSource.size());
+	const view_type aTargetView(&aTarget[0], &aTarget[0] + aTarget.size());
+	std::string aViewDelta;
+	encode_delta(aSourceView, aTargetView, std::back_inserter(aViewDelta));
+	EXPECT_EQ(aViewDelta, aDelta);
+
+	std::istringstream aStream(aDelta);
+	aDecoded.clear();
+	EXPECT_TRUE(apply_delta(aSource, std::istreambuf_iterator<char>(aStream), std::istreambuf_iterator<char>(), aDecoded));
+	EXPECT_EQ(aDecoded, aTarget);
+
+	// Truncated delta and wrong source
+	EXPECT_FALSE(apply_delta(aSource, aDelta.begin(), aDelta.end() - 1, aDecoded));
+	std::vector<unsigned char> aShortSource(aSource.begin(), aSource.end() - 1);
+	EXPECT_FALSE(apply_delta(aShortSource, aDelta.begin(), aDelta.end(), aDecoded));
+
+	// Targets over the limit are rejected before they are allocated
+	EXPECT_FALSE(apply_delta(aSource, aDelta.begin(), aDelta.end(), aDecoded, aTarget.size() - 1));
+	EXPECT_TRUE(apply_delta(aSource, aDelta.begin(), aDelta.end(), aDecoded, aTarget.size()));
+	std::string aHugeDelta;
+	detail::write_varint(size_t(0), std::back_inserter(aHugeDelta));
+	detail::write_varint(~size_t(0) / 2, std::back_inserter(aHugeDelta));
+	std::vector<unsigned char> aHuge;
+	EXPECT_FALSE(apply_delta(std::vector<unsigned char>(), aHugeDelta.begin(), aHugeDelta.end(), aHuge));
+	EXPECT_TRUE(aHuge.empty());
+
+	std::string anEmptyDelta;
+	encode_delta(std::string(), std::string(), std::back_inserter(anEmptyDelta));
+	std::string anEmpty("x");
+	EXPECT_TRUE(apply_delta(std::string(), anEmptyDelta.begin(), anEmptyDelta.end(), anEmpty));
+	EXPECT_TRUE(anEmpty.empty());
+}